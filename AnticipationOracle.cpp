@@ -0,0 +1,252 @@
+//===----------------------------------------------------------------------===//
+//
+// AnticipationOracle - Textbook solver for the anticipated-expressions
+// dataflow problem, and the checks of the engine's sets against it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AnticipationOracle.h"
+#include "ExpressionEquivalence.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace {
+
+using ExprSet = std::set<unsigned>;
+using InstSet = std::set<Instruction *>;
+
+// Numbers the expressions of a function: equivalent instructions get the same
+// number. Quadratic, which is fine for a checker.
+class ExpressionNumbering {
+  const ExpressionEquivalence &Equivalence;
+  SmallVector<Instruction *, 32> Leaders;
+  DenseMap<Instruction *, unsigned> Numbers;
+
+public:
+  explicit ExpressionNumbering(const ExpressionEquivalence &Equivalence)
+      : Equivalence(Equivalence) {}
+
+  unsigned getNumber(Instruction *I) {
+    auto It = Numbers.find(I);
+    if (It != Numbers.end())
+      return It->second;
+    unsigned N = 0;
+    while (N != Leaders.size() && !Equivalence.areEquivalent(Leaders[N], I))
+      ++N;
+    if (N == Leaders.size())
+      Leaders.push_back(I);
+    Numbers[I] = N;
+    return N;
+  }
+};
+
+} // namespace
+
+// Describes the instructions in which two sets of block BB differ.
+static std::string describeMismatch(StringRef What, const BasicBlock &BB,
+                                    const InstSet &Expected,
+                                    const InstSet &Actual) {
+  std::string Msg;
+  raw_string_ostream OS(Msg);
+  OS << What << " set of ";
+  BB.printAsOperand(OS, /*PrintType=*/false);
+  OS << " in function '" << BB.getParent()->getName() << "' differs:";
+  for (Instruction *I : Expected)
+    if (!Actual.count(I))
+      OS << "\n  missing:    " << *I;
+  for (Instruction *I : Actual)
+    if (!Expected.count(I))
+      OS << "\n  unexpected: " << *I;
+  return OS.str();
+}
+
+// Describes the expressions of a set of block BB that the textbook solution
+// does not anticipate there.
+static std::string describeUnsound(StringRef What, const BasicBlock &BB,
+                                   const InstSet &Actual,
+                                   ExpressionNumbering &Numbering,
+                                   const ExprSet &Anticipated) {
+  std::string Msg;
+  raw_string_ostream OS(Msg);
+  OS << What << " set of ";
+  BB.printAsOperand(OS, /*PrintType=*/false);
+  OS << " in function '" << BB.getParent()->getName()
+     << "' holds expressions that are not anticipated there:";
+  for (Instruction *I : Actual)
+    if (!Anticipated.count(Numbering.getNumber(I)))
+      OS << "\n  unexpected: " << *I;
+  return OS.str();
+}
+
+// Describes an instruction in a set of block BB that a copy at BB would not
+// dominate, or a non-empty Out set of a block that does not dominate all of
+// its successors.
+static std::string describeMisplaced(StringRef What, const BasicBlock &BB,
+                                     const Instruction *I) {
+  std::string Msg;
+  raw_string_ostream OS(Msg);
+  OS << What << " set of ";
+  BB.printAsOperand(OS, /*PrintType=*/false);
+  OS << " in function '" << BB.getParent()->getName() << "' ";
+  if (I)
+    OS << "holds an instruction of a block it does not dominate:\n  " << *I;
+  else
+    OS << "is not empty, but the block does not dominate all successors";
+  return OS.str();
+}
+
+std::string
+checkAnticipationSets(Function &F, const DominatorTree &DT,
+                      const ExpressionEquivalence &Equivalence,
+                      function_ref<bool(Instruction *)> IsCandidate,
+                      AnticipationSets &InSets, AnticipationSets &OutSets) {
+  ExpressionNumbering Numbering(Equivalence);
+  SmallVector<BasicBlock *, 32> Blocks(post_order(&F.getEntryBlock()));
+
+  // Use[B]: the candidate instructions of B; Members[e]: all instructions of
+  // expression e.
+  std::map<BasicBlock *, InstSet> Use;
+  std::map<unsigned, InstSet> Members;
+  for (BasicBlock *BB : Blocks)
+    for (Instruction &I : *BB)
+      if (!isa<PHINode>(I) && IsCandidate(&I)) {
+        Use[BB].insert(&I);
+        Members[Numbering.getNumber(&I)].insert(&I);
+      }
+  auto IsKilled = [](Instruction *I, BasicBlock *BB) {
+    for (Value *Op : I->operands())
+      if (auto *OpI = dyn_cast<Instruction>(Op))
+        if (OpI->getParent() == BB)
+          return true;
+    return false;
+  };
+
+  // 1. The textbook equations over expressions, on the whole CFG:
+  //
+  //      Out[B] = the intersection of In[S] over all successors S of B,
+  //               empty if B has none
+  //      In[B]  = Gen[B] | (Out[B] - Kill[B])
+  //
+  //    Gen[B] holds the expressions B computes from values defined above it,
+  //    Kill[B] those B defines an operand of, in every way the function
+  //    spells them. The maximal solution is found from the set of all
+  //    expressions. Nothing the engine anticipates may be missing from it.
+  ExprSet All;
+  for (auto &KV : Members)
+    All.insert(KV.first);
+  std::map<BasicBlock *, ExprSet> Gen, Kill, In, Out;
+  for (BasicBlock *BB : Blocks) {
+    for (Instruction *I : Use[BB])
+      if (!IsKilled(I, BB))
+        Gen[BB].insert(Numbering.getNumber(I));
+    for (auto &KV : Members)
+      if (all_of(KV.second, [&](Instruction *I) { return IsKilled(I, BB); }))
+        Kill[BB].insert(KV.first);
+    In[BB] = All;
+  }
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (BasicBlock *BB : Blocks) {
+      ExprSet NewOut;
+      bool First = true;
+      for (BasicBlock *Succ : successors(BB)) {
+        if (First)
+          NewOut = In[Succ];
+        else
+          for (auto It = NewOut.begin(); It != NewOut.end();)
+            It = In[Succ].count(*It) ? std::next(It) : NewOut.erase(It);
+        First = false;
+      }
+      ExprSet NewIn = Gen[BB];
+      for (unsigned E : NewOut)
+        if (!Kill[BB].count(E))
+          NewIn.insert(E);
+      if (NewOut != Out[BB] || NewIn != In[BB]) {
+        Out[BB] = std::move(NewOut);
+        In[BB] = std::move(NewIn);
+        Changed = true;
+      }
+    }
+  }
+  auto Numbers = [&](const InstSet &Set) {
+    ExprSet Result;
+    for (Instruction *I : Set)
+      Result.insert(Numbering.getNumber(I));
+    return Result;
+  };
+  auto Includes = [](const ExprSet &Set, const ExprSet &Subset) {
+    return std::includes(Set.begin(), Set.end(), Subset.begin(), Subset.end());
+  };
+  for (BasicBlock *BB : Blocks) {
+    if (!Includes(In[BB], Numbers(InSets[BB])))
+      return describeUnsound("In", *BB, InSets[BB], Numbering, In[BB]);
+    if (!Includes(Out[BB], Numbers(OutSets[BB])))
+      return describeUnsound("Out", *BB, OutSets[BB], Numbering, Out[BB]);
+  }
+
+  // 2. Placement: a copy at the end of B must dominate the occurrences it
+  //    replaces, so only blocks dominating all their successors anticipate
+  //    anything at their end, and only instructions of blocks they dominate.
+  for (BasicBlock *BB : Blocks) {
+    bool Dominated = all_of(successors(BB), [&](BasicBlock *Succ) {
+      return DT.dominates(BB, Succ);
+    });
+    if (!Dominated && !OutSets[BB].empty())
+      return describeMisplaced("Out", *BB, nullptr);
+    for (auto *Sets : {&InSets, &OutSets})
+      for (Instruction *I : (*Sets)[BB])
+        if (!DT.dominates(BB, I->getParent()))
+          return describeMisplaced(Sets == &InSets ? "In" : "Out", *BB, I);
+  }
+
+  // 3. Within those limits the sets must be exactly what the equations make
+  //    of the engine's own sets of the successors, instruction by
+  //    instruction: all instances of an expression anticipated on every
+  //    successor, and in In[B] those of Use[B] | Out[B] whose own operands
+  //    are available above B.
+  for (BasicBlock *BB : Blocks) {
+    InstSet ExpectedOut;
+    if (all_of(successors(BB),
+               [&](BasicBlock *Succ) { return DT.dominates(BB, Succ); })) {
+      ExprSet Meet;
+      bool First = true;
+      for (BasicBlock *Succ : successors(BB)) {
+        ExprSet SuccNumbers = Numbers(InSets[Succ]);
+        if (First)
+          Meet = std::move(SuccNumbers);
+        else
+          for (auto It = Meet.begin(); It != Meet.end();)
+            It = SuccNumbers.count(*It) ? std::next(It) : Meet.erase(It);
+        First = false;
+      }
+      for (BasicBlock *Succ : successors(BB))
+        for (Instruction *I : InSets[Succ])
+          if (Meet.count(Numbering.getNumber(I)))
+            ExpectedOut.insert(I);
+    }
+    if (OutSets[BB] != ExpectedOut)
+      return describeMismatch("Out", *BB, ExpectedOut, OutSets[BB]);
+
+    InstSet ExpectedIn;
+    for (const InstSet *Set : {&Use[BB], &OutSets[BB]})
+      for (Instruction *I : *Set)
+        if (!IsKilled(I, BB))
+          ExpectedIn.insert(I);
+    if (InSets[BB] != ExpectedIn)
+      return describeMismatch("In", *BB, ExpectedIn, InSets[BB]);
+  }
+  return "";
+}
@@ -0,0 +1,63 @@
+//===----------------------------------------------------------------------===//
+//
+// AnticipationOracle - A deliberately simple reference solver for the
+// anticipated-expressions dataflow problem, used to check the In/Out sets of
+// HoistAnticipatedExpressionsPass.
+//
+// The oracle numbers the expressions of a function (equivalent instructions
+// share a number, see ExpressionEquivalence.h) and solves the textbook
+// equations over them on the whole CFG,
+//
+//   Out[B] = the intersection of In[S] over all successors S of B
+//   In[B]  = Gen[B] | (Out[B] - Kill[B])
+//
+// for their maximal solution, independently of the engine. The engine's sets
+// are then checked in three steps:
+//
+//   1. soundness: every expression they anticipate, the textbook does too;
+//   2. placement: only blocks dominating all their successors anticipate
+//      anything at their end, and only instructions of blocks they dominate,
+//      so a hoisted copy dominates the occurrences it replaces;
+//   3. consistency: within those limits, the sets of every block are what
+//      the equations make of the sets of its successors, instruction by
+//      instruction.
+//
+// It favours being obviously right over being fast, so any faster engine can
+// be checked against it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef HOIST_ANTICIPATED_EXPRESSIONS_ANTICIPATIONORACLE_H
+#define HOIST_ANTICIPATED_EXPRESSIONS_ANTICIPATIONORACLE_H
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+
+#include <map>
+#include <set>
+#include <string>
+
+namespace llvm {
+class BasicBlock;
+class DominatorTree;
+class Function;
+class Instruction;
+} // namespace llvm
+
+class ExpressionEquivalence;
+
+/// The per-block expression sets of the dataflow engine.
+using AnticipationSets =
+    std::map<llvm::BasicBlock *, std::set<llvm::Instruction *>>;
+
+/// Compares \p InSets and \p OutSets against the reference solution for \p F,
+/// where \p Equivalence tells which instructions are the same expression and
+/// \p IsCandidate which instructions are expressions the pass may hoist.
+/// Returns a description of the first block whose sets differ, or an empty
+/// string if all of them match.
+std::string
+checkAnticipationSets(llvm::Function &F, const llvm::DominatorTree &DT,
+                      const ExpressionEquivalence &Equivalence,
+                      llvm::function_ref<bool(llvm::Instruction *)> IsCandidate,
+                      AnticipationSets &InSets, AnticipationSets &OutSets);
+
+#endif // HOIST_ANTICIPATED_EXPRESSIONS_ANTICIPATIONORACLE_H
@@ -0,0 +1,123 @@
+//===----------------------------------------------------------------------===//
+//
+// ExpressionEquivalence - Identical, same-address or SCEV-equal instructions.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ExpressionEquivalence.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Operator.h"
+
+using namespace llvm;
+
+namespace {
+
+// Collects the opaque values a SCEV is built from.
+struct LeafCollector {
+  SmallPtrSetImpl<const Value *> &Leaves;
+
+  bool follow(const SCEV *S) {
+    if (auto *U = dyn_cast<SCEVUnknown>(S))
+      Leaves.insert(U->getValue());
+    return true;
+  }
+  bool isDone() const { return false; }
+};
+
+} // namespace
+
+// Returns true if A and B are GEPs that add the same constant byte offset to
+// the same pointer, whatever types they index through.
+static bool isSameAddress(const Instruction *A, const Instruction *B) {
+  auto *GA = dyn_cast<GEPOperator>(A);
+  auto *GB = dyn_cast<GEPOperator>(B);
+  if (!GA || !GB || GA->getType() != GB->getType() ||
+      GA->getType()->isVectorTy() ||
+      GA->getPointerOperand() != GB->getPointerOperand())
+    return false;
+  const DataLayout &DL = A->getModule()->getDataLayout();
+  unsigned Width = DL.getIndexTypeSizeInBits(GA->getType());
+  APInt OffsetA(Width, 0), OffsetB(Width, 0);
+  return GA->accumulateConstantOffset(DL, OffsetA) &&
+         GB->accumulateConstantOffset(DL, OffsetB) && OffsetA == OffsetB;
+}
+
+// Returns true if I can only be poison when one of the values S is built from
+// is, once the poison-generating flags of the instructions appended to Drop
+// are cleared. Otherwise the SCEV has folded away a source of poison (x - x
+// is 0 even when x is poison) and I must not stand in for another
+// instruction with the same SCEV. The walk is the one SCEVExpander does
+// before it reuses an existing instruction, bounded the same way.
+static bool isPoisonSafe(const SCEV *S, Instruction *I,
+                         SmallVectorImpl<Instruction *> &Drop) {
+  SmallPtrSet<const Value *, 8> Leaves;
+  LeafCollector Collector{Leaves};
+  visitAll(S, Collector);
+
+  SmallVector<Value *, 8> Worklist = {I};
+  SmallPtrSet<Value *, 8> Visited;
+  while (!Worklist.empty()) {
+    Value *V = Worklist.pop_back_val();
+    if (!Visited.insert(V).second)
+      continue;
+    if (Visited.size() > 16)
+      return false;
+    if (Leaves.count(V) || isGuaranteedNotToBePoison(V))
+      continue;
+    auto *VI = dyn_cast<Instruction>(V);
+    if (!VI || canCreatePoison(cast<Operator>(VI), /*ConsiderFlags=*/false))
+      return false;
+    Drop.push_back(VI);
+    for (Value *Op : VI->operands())
+      Worklist.push_back(Op);
+  }
+  return true;
+}
+
+bool ExpressionEquivalence::areEquivalent(Instruction *A,
+                                          Instruction *B) const {
+  if (A->isIdenticalToWhenDefined(B) || isSameAddress(A, B))
+    return true;
+  if (!SE || isa<PHINode>(A) || isa<PHINode>(B) ||
+      A->getType() != B->getType() || !SE->isSCEVable(A->getType()))
+    return false;
+  const SCEV *S = SE->getSCEV(A);
+  if (isa<SCEVUnknown>(S) || S != SE->getSCEV(B))
+    return false;
+  SmallVector<Instruction *, 8> Drop;
+  return isPoisonSafe(S, A, Drop) && isPoisonSafe(S, B, Drop);
+}
+
+void ExpressionEquivalence::mergeInto(Instruction &Survivor,
+                                      Instruction &Copy) const {
+  if (Survivor.isIdenticalTo(&Copy))
+    return;
+  // Same operation, or same address: only the flags can differ, and the
+  // survivor keeps those both of them have.
+  if (Survivor.isIdenticalToWhenDefined(&Copy) ||
+      isSameAddress(&Survivor, &Copy)) {
+    Survivor.andIRFlags(&Copy);
+    forget(Survivor);
+    return;
+  }
+  // The survivor may be poison only where the copy is; an overflow flag the
+  // copy does not have (nuw on a shl replacing a mul) would break that.
+  SmallVector<Instruction *, 8> Drop;
+  isPoisonSafe(SE->getSCEV(&Survivor), &Survivor, Drop);
+  for (Instruction *I : Drop) {
+    I->dropPoisonGeneratingAnnotations();
+    forget(*I);
+  }
+}
+
+void ExpressionEquivalence::forget(Instruction &I) const {
+  if (SE)
+    SE->forgetValue(&I);
+}
@@ -0,0 +1,56 @@
+//===----------------------------------------------------------------------===//
+//
+// ExpressionEquivalence - Decides which instructions HoistAnticipatedExpressions
+// (and its reference solver) treat as the same expression.
+//
+// Instructions that are identical but for their poison-generating flags are
+// always equivalent (add nsw and add, or two GEPs that differ only in
+// inbounds/nuw), and so are GEPs that add the same constant byte offset to the
+// same pointer whatever they index through (gep i8, p, 16 and gep i32, p, 4).
+// With ScalarEvolution, so are integer and pointer instructions of the same
+// type whose SCEVs are the same expression, such as i*4+base and
+// (i<<2)+base, or a GEP over i32 and one over i8 with a scaled index. SCEVs
+// that are just an opaque value (SCEVUnknown) are not matched, which keeps
+// the relation transitive: identical instructions over modelled operations
+// always share a SCEV.
+//
+// SCEV-equal instructions compute the same value wherever neither is poison.
+// They are only matched if each of them can be poison just when a value the
+// SCEV is built from is, so that either one may stand in for the other once
+// it gives up its overflow flags (see mergeInto).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef HOIST_ANTICIPATED_EXPRESSIONS_EXPRESSIONEQUIVALENCE_H
+#define HOIST_ANTICIPATED_EXPRESSIONS_EXPRESSIONEQUIVALENCE_H
+
+namespace llvm {
+class Instruction;
+class ScalarEvolution;
+} // namespace llvm
+
+class ExpressionEquivalence {
+public:
+  /// Without \p SE only identical instructions are equivalent.
+  explicit ExpressionEquivalence(llvm::ScalarEvolution *SE = nullptr)
+      : SE(SE) {}
+
+  /// Returns true if \p A and \p B compute the same expression.
+  bool areEquivalent(llvm::Instruction *A, llvm::Instruction *B) const;
+
+  /// Prepares \p Survivor to replace \p Copy, an instruction equivalent to
+  /// it. Of two GEPs for the same address the survivor keeps the wrap flags both
+  /// have. Otherwise, unless the two are identical, the poison-generating
+  /// flags of the survivor and of the operands it is computed from are
+  /// dropped.
+  void mergeInto(llvm::Instruction &Survivor, llvm::Instruction &Copy) const;
+
+  /// Drops what ScalarEvolution knows about \p I before it is moved, changed
+  /// or erased.
+  void forget(llvm::Instruction &I) const;
+
+private:
+  llvm::ScalarEvolution *SE;
+};
+
+#endif // HOIST_ANTICIPATED_EXPRESSIONS_EXPRESSIONEQUIVALENCE_H
@@ -14,31 +14,245 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "AnticipationOracle.h"
+#include "ExpressionEquivalence.h"
+#include "LocalVerifier.h"
+#include "PerfCounters.h"
 #include "llvm/ADT/BreadthFirstIterator.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/DepthFirstIterator.h"
 #include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SetOperations.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Analysis/DomTreeUpdater.h"
+#include "llvm/Analysis/HeatUtils.h"
+#include "llvm/Analysis/LazyValueInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/CFG.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/OptBisect.h"
 #include "llvm/IR/PassManager.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/DebugCounter.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/GraphWriter.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
 
+#include <array>
+#include <chrono>
 #include <map>
+#include <optional>
+#include <queue>
 #include <set>
+#include <string>
 
 using namespace llvm;
 
 #define DEBUG_TYPE "hoist-anticipated-expressions"
 
+DEBUG_COUNTER(HoistCounter, "hoist-anticipated-expressions-hoist",
+              "Controls which hoists and rewrites "
+              "hoist-anticipated-expressions performs");
+
+static cl::opt<bool> CollectPerfCounters(
+    "hoist-anticipated-perf-counters", cl::init(false), cl::Hidden,
+    cl::desc("Measure every phase of hoist-anticipated-expressions with "
+             "hardware performance counters and print the totals per "
+             "function to stderr"));
+
+static cl::opt<bool> RecordProvenance(
+    "hoist-anticipated-provenance", cl::init(false), cl::Hidden,
+    cl::desc("Attach !hoist.provenance metadata listing the original block "
+             "and debug location of every occurrence merged into a hoisted "
+             "instruction"));
+
+static cl::opt<bool> UseSCEVEquivalence(
+    "hoist-anticipated-scev-equivalence", cl::init(true), cl::Hidden,
+    cl::desc("Treat instructions with the same scalar evolution, such as "
+             "i*4+base and (i<<2)+base, as one expression"));
+
+static cl::opt<bool> WidenCasts(
+    "hoist-anticipated-widen-casts", cl::init(true), cl::Hidden,
+    cl::desc("Fold extension chains and rewrite zext/sext of narrow "
+             "arithmetic that cannot wrap into the wide arithmetic computed "
+             "elsewhere in the function, so the two forms can be merged"));
+
+static cl::opt<unsigned> MaxHoists(
+    "hoist-anticipated-max-hoists", cl::init(0), cl::Hidden,
+    cl::desc("Stop after this many hoists and cast rewrites per function, "
+             "the most valuable hoists first (0 = no limit)"));
+
+static cl::opt<unsigned> TimeBudgetMs(
+    "hoist-anticipated-time-budget-ms", cl::init(0), cl::Hidden,
+    cl::desc("Stop hoisting in a function once the pass has spent this many "
+             "milliseconds on it (0 = no limit)"));
+
+static cl::opt<unsigned> MaxHoistsPerBlock(
+    "hoist-anticipated-max-hoists-per-block", cl::init(0), cl::Hidden,
+    cl::desc("Move at most this many instructions into any one block, each "
+             "of which stays live across its branch (0 = no limit)"));
+
+static cl::opt<bool> FoldSelectArms(
+    "hoist-anticipated-select-arms", cl::init(true), cl::Hidden,
+    cl::desc("Merge equivalent select arms and turn select c, f(x), f(y) "
+             "into f(select c, x, y) when the target cost model favors it"));
+
+static cl::opt<bool> FoldBranches(
+    "hoist-anticipated-fold-branches", cl::init(true), cl::Hidden,
+    cl::desc("Fold the branches a hoisted comparison decides: uses of it "
+             "dominated by an edge of a branch on it get its known value"));
+
+// Where the plugin adds the pass to the default<On> pipelines by itself.
+enum class PipelinePosition {
+  None,
+  Peephole,
+  ScalarOptimizerLate,
+  VectorizerStart,
+  OptimizerLast
+};
+
+static cl::opt<PipelinePosition> Position(
+    "hoist-anticipated-pipeline-position", cl::init(PipelinePosition::None),
+    cl::Hidden,
+    cl::desc("Add hoist-anticipated-expressions to the default pipelines at "
+             "this extension point"),
+    cl::values(
+        clEnumValN(PipelinePosition::None, "none", "Do not add the pass"),
+        clEnumValN(PipelinePosition::Peephole, "peephole",
+                   "After every instcombine"),
+        clEnumValN(PipelinePosition::ScalarOptimizerLate, "scalar-late",
+                   "At the end of the function simplification pipeline"),
+        clEnumValN(PipelinePosition::VectorizerStart, "vectorizer-start",
+                   "Right before the loop vectorizer, in "
+                   "vectorization-friendly mode"),
+        clEnumValN(PipelinePosition::OptimizerLast, "optimizer-last",
+                   "At the very end of the optimization pipeline")));
+
+static cl::opt<bool> VerifyDataflow(
+    "hoist-anticipated-verify-dataflow", cl::init(false), cl::Hidden,
+    cl::desc("Check the In/Out sets of every iteration against the reference "
+             "solver and abort on the first difference"));
+
+static cl::opt<bool> VerifyTouched(
+    "hoist-anticipated-verify-touched", cl::init(false), cl::Hidden,
+    cl::desc("Check the terminators, phis and dominance of uses of every "
+             "block the pass changed, instead of the whole function, and "
+             "abort on the first problem"));
+
+static cl::opt<std::string> DotFilenamePrefix(
+    "hoist-anticipated-dot-filename-prefix", cl::init("anticipated"),
+    cl::Hidden,
+    cl::desc("The prefix used for the dot-anticipated-expressions output "
+             "files"));
+
+static cl::opt<unsigned> DotSummaryBlocks(
+    "hoist-anticipated-dot-summary-blocks", cl::init(64), cl::Hidden,
+    cl::desc("Summarize the dot-anticipated-expressions graphs of functions "
+             "with more blocks than this: hoists are counted instead of "
+             "listed"));
+
 namespace {
 
+// Called for every hoist with the surviving instruction, the block it now
+// lives in, whether it was moved there (rather than copies merged into an
+// instruction the block already had), and the blocks whose copies (or
+// original) it replaces.
+using HoistCallback =
+    function_ref<void(Instruction &Inst, BasicBlock &Target, bool Moved,
+                      ArrayRef<BasicBlock *> Sources)>;
+
+// A hoist the dataflow has found: Inst, found in Source, is to be computed
+// at the end of Target (where it already is if Source is Target) for Copies.
+struct HoistCandidate {
+  BasicBlock *Target = nullptr;
+  Instruction *Inst = nullptr;
+  BasicBlock *Source = nullptr;
+  SmallVector<Instruction *, 4> Copies;
+  // The blocks of Copies when the hoist was found.
+  SmallVector<BasicBlock *, 4> CopyBlocks;
+  // Hoists are applied by Tier, then by Benefit, both highest first, then
+  // in the order they were found.
+  unsigned Tier = 0;
+  double Benefit = 0.0;
+  unsigned Order = 0;
+};
+
+// The limits of one run of the pass over a function, from the
+// -hoist-anticipated-max-hoists, -time-budget-ms and -max-hoists-per-block
+// options.
+class HoistBudget {
+  using Clock = std::chrono::steady_clock;
+
+public:
+  HoistBudget() {
+    if (TimeBudgetMs)
+      Deadline = Clock::now() + std::chrono::milliseconds(TimeBudgetMs);
+  }
+
+  bool isExhausted() const {
+    return (MaxHoists && NumHoisted >= MaxHoists) ||
+           (Deadline && Clock::now() >= *Deadline);
+  }
+  bool allowsInto(const BasicBlock *BB) const {
+    return !MaxHoistsPerBlock || MovedInto.lookup(BB) < MaxHoistsPerBlock;
+  }
+  /// Counts a hoist into \p BB; \p Moved if an instruction was moved there
+  /// rather than copies merged into one it already had.
+  void recordHoist(const BasicBlock *BB, bool Moved) {
+    ++NumHoisted;
+    if (Moved)
+      ++MovedInto[BB];
+  }
+  /// Counts a cast rewrite, which moves nothing but spends the same budget.
+  void recordRewrite() { ++NumHoisted; }
+
+private:
+  std::optional<Clock::time_point> Deadline;
+  unsigned NumHoisted = 0;
+  DenseMap<const BasicBlock *, unsigned> MovedInto;
+};
+
 class HoistAnticipatedExpressionsPass
     : public PassInfoMixin<HoistAnticipatedExpressionsPass> {
 public:
+  /// In vectorization-friendly mode, the pass runs right before the loop
+  /// vectorizer and hoists into a loop only what leaves a predicated block of
+  /// the loop empty for if-conversion, innermost loops first.
+  explicit HoistAnticipatedExpressionsPass(bool VectorizeFriendly = false)
+      : VectorizeFriendly(VectorizeFriendly) {}
   PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+  unsigned hoistAnticipatedExpressions(Function &F, const TargetLibraryInfo &TLI,
+                                       HoistCallback OnHoist = nullptr);
+  void computeUseDefSets(Function &F, const TargetLibraryInfo &TLI,
+                         std::map<BasicBlock *, std::set<Instruction *>> &UseSets,
+                         std::map<BasicBlock *, std::set<Instruction *>> &DefSets);
+  void computeInOutSets(Function &F, const DominatorTree &DT,
+                        std::map<BasicBlock *, std::set<Instruction *>> &UseSets,
+                        std::map<BasicBlock *, std::set<Instruction *>> &DefSets,
+                        std::map<BasicBlock *, std::set<Instruction *>> &InSets,
+                        std::map<BasicBlock *, std::set<Instruction *>> &OutSets);
+  void setAnalyses(Function &F, FunctionAnalysisManager &FAM);
 
 private:
   bool isFunctionPure(CallInst *CI, const TargetLibraryInfo &TLI);
@@ -53,16 +267,134 @@ private:
                  std::map<BasicBlock *, std::set<Instruction *>> &DefSets,
                  std::map<BasicBlock *, std::set<Instruction *>> &InSets,
                  std::map<BasicBlock *, std::set<Instruction *>> &OutSets);
-  void findOutSet(BasicBlock *BB,
+  void findOutSet(BasicBlock *BB, const DominatorTree &DT,
                   std::map<BasicBlock *, std::set<Instruction *>> &UseSets,
                   std::map<BasicBlock *, std::set<Instruction *>> &DefSets,
                   std::map<BasicBlock *, std::set<Instruction *>> &InSets,
                   std::map<BasicBlock *, std::set<Instruction *>> &OutSets);
   Instruction *checkBeforeMove(BasicBlock *BB, Instruction *inst);
-  bool hoistInstructions(BasicBlock *BB,
-                          std::map<BasicBlock *, std::set<Instruction *>> &OutSets);
+  void findHoistCandidates(BasicBlock *BB, const DominatorTree &DT,
+                           std::map<BasicBlock *, std::set<Instruction *>> &OutSets,
+                           SmallPtrSetImpl<Instruction *> &Claimed,
+                           std::vector<HoistCandidate> &Found);
+  unsigned applyHoists(std::vector<HoistCandidate> &Candidates,
+                       HoistBudget &Budget, HoistCallback OnHoist);
+  void selectVectorizationHoists(std::vector<HoistCandidate> &Candidates,
+                                 const DominatorTree &DT, const LoopInfo &LI,
+                                 const TargetLibraryInfo &TLI);
+  unsigned widenCasts(Function &F, const DominatorTree &DT,
+                      const TargetLibraryInfo &TLI, const LoopInfo *Loops,
+                      HoistBudget &Budget);
+  unsigned foldSelectArms(Function &F, const TargetLibraryInfo &TLI);
+  unsigned foldDominatedBranches(Function &F, DominatorTree &DT);
+
+  bool VectorizeFriendly;
+  ExpressionEquivalence Equivalence;
+  AssumptionCache *AC = nullptr;
+  BlockFrequencyInfo *BFI = nullptr;
+  LazyValueInfo *LVI = nullptr;
+  const TargetTransformInfo *TTI = nullptr;
+  // The comparisons hoisted (or merged into) so far, for branch folding.
+  SmallVector<WeakVH, 8> HoistedConditions;
+  // The blocks changed so far, for -hoist-anticipated-verify-touched; blocks
+  // deleted by branch folding drop out.
+  SmallVector<WeakVH, 16> TouchedBlocks;
+};
+
+// Analysis-only "what-if" mode: simulates the pass on a clone of every
+// function and prints each hoist with its TTI cost, the block frequencies of
+// the source and target blocks and the estimated weighted cycles saved.
+class HoistAnticipatedExpressionsReportPass
+    : public PassInfoMixin<HoistAnticipatedExpressionsReportPass> {
+  raw_ostream &OS;
+
+public:
+  explicit HoistAnticipatedExpressionsReportPass(raw_ostream &OS) : OS(OS) {}
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+  static bool isRequired() { return true; }
+};
+
+// Writes the CFG of every function to <prefix>.<function>.dot, each block
+// labeled with its In/Out set sizes (before the first hoist), the expressions
+// hoisted into and out of it, and its block frequency as a heat-map color.
+class DOTAnticipatedExpressionsPass
+    : public PassInfoMixin<DOTAnticipatedExpressionsPass> {
+public:
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+  static bool isRequired() { return true; }
 };
 
+// Phases measured by -hoist-anticipated-perf-counters.
+enum Phase { UseDefPhase, DataflowPhase, HoistPhase, NumPhases };
+static const char *const PhaseNames[NumPhases] = {"UseDef", "Dataflow",
+                                                  "Hoist"};
+using PhaseCounterTotals = std::array<PerfCounters::Values, NumPhases>;
+
+// Returns the process-wide counters, or null when they are disabled or the
+// host does not provide them (reported once).
+static PerfCounters *getPerfCounters() {
+  if (!CollectPerfCounters)
+    return nullptr;
+  static PerfCounters Counters;
+  static bool Reported = false;
+  if (!Counters.isAvailable()) {
+    if (!Reported)
+      errs() << "hoist-anticipated-expressions perf: hardware counters "
+                "unavailable ("
+             << Counters.getError() << ")\n";
+    Reported = true;
+    return nullptr;
+  }
+  return &Counters;
+}
+
+// Adds the counter deltas over its lifetime to one phase total.
+class PhaseCounterScope {
+  PerfCounters *Counters;
+  PerfCounters::Values &Total;
+  PerfCounters::Values Start;
+
+public:
+  PhaseCounterScope(PerfCounters *Counters, PerfCounters::Values &Total)
+      : Counters(Counters), Total(Total) {
+    if (Counters)
+      Start = Counters->read();
+  }
+  ~PhaseCounterScope() {
+    if (!Counters)
+      return;
+    PerfCounters::Values End = Counters->read();
+    for (unsigned C = 0; C != PerfCounters::NumCounters; ++C)
+      Total[C] += End[C] - Start[C];
+  }
+};
+
+static void printPhaseCounters(const Function &F, const PerfCounters &Counters,
+                               const PhaseCounterTotals &Totals) {
+  for (unsigned P = 0; P != NumPhases; ++P) {
+    errs() << "hoist-anticipated-expressions perf: " << F.getName() << " "
+           << PhaseNames[P];
+    for (unsigned C = 0; C != PerfCounters::NumCounters; ++C) {
+      auto Counter = PerfCounters::Counter(C);
+      errs() << " " << PerfCounters::getName(Counter) << "=";
+      if (Counters.isAvailable(Counter))
+        errs() << Totals[P][C];
+      else
+        errs() << "n/a";
+    }
+    errs() << "\n";
+  }
+}
+
+// Sum of the set sizes over all blocks, reported in -time-trace events.
+static size_t
+totalSetSize(const std::map<BasicBlock *, std::set<Instruction *>> &Sets) {
+  size_t Size = 0;
+  for (auto &KV : Sets)
+    Size += KV.second.size();
+  return Size;
+}
+
 bool HoistAnticipatedExpressionsPass::isFunctionPure(CallInst *CI,
                                                      const TargetLibraryInfo &TLI) {
   Function *Called = CI->getCalledFunction();
@@ -115,110 +447,1292 @@ void HoistAnticipatedExpressionsPass::findInSet(
     std::map<BasicBlock *, std::set<Instruction *>> &DefSets,
     std::map<BasicBlock *, std::set<Instruction *>> &InSets,
     std::map<BasicBlock *, std::set<Instruction *>> &OutSets) {
+  // An instruction anticipated at the end of BB cannot be anticipated at its
+  // start if BB defines one of its operands (e.g. the load feeding the decode
+  // arithmetic of every case of a switch in a loop header). Instructions are
+  // killed one by one: an equivalent one computed from other operands may
+  // still be anticipated.
+  auto UsesDefOf = [&](Instruction *I) {
+    return any_of(I->operands(), [&](Value *Op) {
+      auto *OpI = dyn_cast<Instruction>(Op);
+      return OpI && OpI->getParent() == BB;
+    });
+  };
   for (auto *I : OutSets[BB])
-    if (std::none_of(DefSets[BB].begin(), DefSets[BB].end(),
-                     [&](Instruction *DI) { return I->isIdenticalTo(DI); }))
+    if (!UsesDefOf(I))
       InSets[BB].insert(I);
 
   for (auto *I : UseSets[BB])
-    if (std::none_of(DefSets[BB].begin(), DefSets[BB].end(),
-                     [&](Instruction *DI) { return I->isIdenticalTo(DI); }))
+    if (!DefSets[BB].count(I))
       InSets[BB].insert(I);
 }
 
 void HoistAnticipatedExpressionsPass::findOutSet(
-    BasicBlock *BB, std::map<BasicBlock *, std::set<Instruction *>> &UseSets,
+    BasicBlock *BB, const DominatorTree &DT,
+    std::map<BasicBlock *, std::set<Instruction *>> &UseSets,
     std::map<BasicBlock *, std::set<Instruction *>> &DefSets,
     std::map<BasicBlock *, std::set<Instruction *>> &InSets,
     std::map<BasicBlock *, std::set<Instruction *>> &OutSets) {
-  std::map<Instruction *, int> count;
-  int totalSucc = succ_size(BB);
+  // Only successors dominated by BB count: past a join from elsewhere (or
+  // along a back edge) a copy hoisted into BB would not dominate the
+  // occurrences it replaces.
+  for (BasicBlock *Succ : successors(BB))
+    if (!DT.dominates(BB, Succ))
+      return;
 
-  for (BasicBlock *Succ : successors(BB)) {
-    std::map<Instruction *, bool> seen;
-    for (auto *I : InSets[Succ])
-      seen[I] = false;
+  // Group the instructions of the successors' In sets by expression, counting
+  // every expression once per successor however many equivalent instructions
+  // stand for it there.
+  struct Expression {
+    SmallVector<Instruction *, 4> Instances;
+    unsigned NumSuccs = 0;
+  };
+  SmallVector<Expression, 16> Expressions;
+  unsigned TotalSuccs = succ_size(BB);
 
+  for (BasicBlock *Succ : successors(BB)) {
+    std::set<size_t> Seen;
     for (auto *I : InSets[Succ]) {
-      bool matched = false;
-      for (auto &KV : count)
-        if (I->isIdenticalTo(KV.first) && !seen[KV.first]) {
-          KV.second++;
-          matched = true;
-          seen[KV.first] = true;
-        }
-      if (!matched)
-        count[I] = 1;
+      size_t N = find_if(Expressions,
+                         [&](const Expression &E) {
+                           return Equivalence.areEquivalent(
+                               I, E.Instances.front());
+                         }) -
+                 Expressions.begin();
+      if (N == Expressions.size())
+        Expressions.emplace_back();
+      Expressions[N].Instances.push_back(I);
+      if (Seen.insert(N).second)
+        ++Expressions[N].NumSuccs;
     }
   }
 
-  for (auto &KV : count)
-    if (KV.second == totalSucc)
-      OutSets[BB].insert(KV.first);
+  // Every instance of an expression anticipated on all successors stays, so
+  // that each of them is killed by its own operands further up.
+  for (Expression &E : Expressions)
+    if (E.NumSuccs == TotalSuccs)
+      OutSets[BB].insert(E.Instances.begin(), E.Instances.end());
+}
+
+static bool isDivRem(const Instruction *I) {
+  switch (I->getOpcode()) {
+  case Instruction::UDiv:
+  case Instruction::URem:
+  case Instruction::SDiv:
+  case Instruction::SRem:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Returns true if Inst, computed under a condition so far, may execute at
+// the end of BB on every path. Only integer division and remainder can trap:
+// the divisor has to be non-zero there, from a constant, an llvm.assume, a
+// guard or a dominating branch condition (LazyValueInfo) or its known bits,
+// and it must not be poison. A signed division additionally must not divide
+// INT_MIN by -1.
+static bool isSafeToHoistTo(Instruction *Inst, BasicBlock *BB,
+                            const DominatorTree &DT, AssumptionCache *AC,
+                            LazyValueInfo *LVI) {
+  if (!isDivRem(Inst))
+    return true;
+  if (isSafeToSpeculativelyExecute(Inst))
+    return true;
+  if (!LVI || !Inst->getType()->isIntegerTy())
+    return false;
+
+  Instruction *CtxI = BB->getTerminator();
+  const DataLayout &DL = BB->getDataLayout();
+  unsigned BitWidth = Inst->getType()->getIntegerBitWidth();
+  Value *Divisor = Inst->getOperand(1);
+  ConstantRange DivisorRange =
+      LVI->getConstantRange(Divisor, CtxI, /*UndefAllowed=*/false);
+  bool NonZero = !DivisorRange.contains(APInt::getZero(BitWidth)) ||
+                 isKnownNonZero(Divisor, SimplifyQuery(DL, &DT, AC, CtxI));
+  if (!NonZero || !isGuaranteedNotToBePoison(Divisor, AC, CtxI, &DT))
+    return false;
+  if (Inst->getOpcode() == Instruction::UDiv ||
+      Inst->getOpcode() == Instruction::URem)
+    return true;
+  return !DivisorRange.contains(APInt::getAllOnes(BitWidth)) ||
+         !LVI->getConstantRange(Inst->getOperand(0), CtxI,
+                                /*UndefAllowed=*/false)
+              .contains(APInt::getSignedMinValue(BitWidth));
+}
+
+static double costInCycles(InstructionCost Cost) {
+  return Cost.isValid() ? double(Cost.getValue()) : 0.0;
+}
+
+static double relativeFrequency(const BlockFrequencyInfo &BFI,
+                                const BasicBlock *BB) {
+  return double(BFI.getBlockFreq(BB).getFrequency()) /
+         double(BFI.getEntryFreq().getFrequency());
+}
+
+// Weighted cycles saved by a hoist of an expression costing Cost: it no
+// longer executes in Sources, and executes in Target instead if it Moved
+// there. Merged into an instruction Target already had, it costs nothing
+// more there.
+static double weightedCyclesSaved(double Cost, const BlockFrequencyInfo &BFI,
+                                  const BasicBlock *Target, bool Moved,
+                                  ArrayRef<const BasicBlock *> Sources) {
+  double Executions = Moved ? -relativeFrequency(BFI, Target) : 0.0;
+  for (const BasicBlock *Source : Sources)
+    Executions += relativeFrequency(BFI, Source);
+  return Cost * Executions;
+}
+
+// Every change the pass makes to the IR (a hoist, a cast rewrite, a select
+// fold or the folding of a branch) is a -opt-bisect-limit point of its own
+// and is counted by -debug-counter=hoist-anticipated-expressions-hoist=...,
+// so a regression can be bisected down to a single change. Step names the
+// kind of change, Inst the instruction it rewrites and Into, for hoists, the
+// block it goes to.
+static bool shouldChange(StringRef Step, Instruction *Inst,
+                         BasicBlock *Into = nullptr) {
+  OptPassGate &Gate = Inst->getContext().getOptPassGate();
+  if (Gate.isEnabled()) {
+    std::string Desc;
+    raw_string_ostream OS(Desc);
+    OS << Inst->getOpcodeName() << " ";
+    if (Inst->getType()->isVoidTy()) {
+      OS << "in ";
+      Inst->getParent()->printAsOperand(OS, /*PrintType=*/false);
+    } else {
+      Inst->printAsOperand(OS, /*PrintType=*/false);
+    }
+    if (Into) {
+      OS << " into ";
+      Into->printAsOperand(OS, /*PrintType=*/false);
+    }
+    OS << " in function (" << Inst->getFunction()->getName() << ")";
+    if (!Gate.shouldRunPass(("HoistAnticipatedExpressionsPass " + Step).str(),
+                            OS.str()))
+      return false;
+  }
+  return DebugCounter::shouldExecute(HoistCounter);
+}
+
+// Appends the provenance of one occurrence merged into a hoisted instruction:
+// the entries it carries from earlier hoists, or an entry for itself,
+// !{!"<block>", !"<file>", i32 <line>, i32 <column>}, where the location is
+// left out without debug info. (The verifier does not allow DILocations in
+// such nodes, hence the plain values.)
+static void appendProvenance(Instruction &I,
+                             SmallVectorImpl<Metadata *> &Entries) {
+  if (MDNode *Recorded = I.getMetadata("hoist.provenance")) {
+    for (const MDOperand &Entry : Recorded->operands())
+      Entries.push_back(Entry.get());
+    return;
+  }
+  std::string Block;
+  raw_string_ostream OS(Block);
+  I.getParent()->printAsOperand(OS, /*PrintType=*/false);
+  LLVMContext &Ctx = I.getContext();
+  SmallVector<Metadata *, 4> Entry = {MDString::get(Ctx, OS.str())};
+  if (const DILocation *Loc = I.getDebugLoc().get()) {
+    Type *Int32Ty = Type::getInt32Ty(Ctx);
+    Entry.push_back(MDString::get(Ctx, Loc->getFilename()));
+    Entry.push_back(ConstantAsMetadata::get(
+        ConstantInt::get(Int32Ty, Loc->getLine())));
+    Entry.push_back(ConstantAsMetadata::get(
+        ConstantInt::get(Int32Ty, Loc->getColumn())));
+  }
+  Entries.push_back(MDTuple::get(Ctx, Entry));
 }
 
 Instruction *HoistAnticipatedExpressionsPass::checkBeforeMove(
     BasicBlock *BB, Instruction *Inst) {
   for (Instruction &I : *BB)
-    if (I.isIdenticalTo(Inst))
+    if (Equivalence.areEquivalent(&I, Inst))
       return &I;
   return nullptr;
 }
 
-bool HoistAnticipatedExpressionsPass::hoistInstructions(
-    BasicBlock *BB, std::map<BasicBlock *, std::set<Instruction *>> &OutSets) {
-  bool Changed = false;
-  std::set<Instruction *> ToDelete;
+void HoistAnticipatedExpressionsPass::findHoistCandidates(
+    BasicBlock *BB, const DominatorTree &DT,
+    std::map<BasicBlock *, std::set<Instruction *>> &OutSets,
+    SmallPtrSetImpl<Instruction *> &Claimed,
+    std::vector<HoistCandidate> &Found) {
+  // Visit the candidates in program order rather than in pointer order, so
+  // that the hoists are numbered the same way in every run.
+  SmallVector<Instruction *, 8> Candidates(OutSets[BB].begin(),
+                                           OutSets[BB].end());
+  if (Candidates.size() > 1) {
+    DenseMap<const BasicBlock *, unsigned> BlockIndex;
+    for (BasicBlock &Block : *BB->getParent())
+      BlockIndex.try_emplace(&Block, BlockIndex.size());
+    llvm::sort(Candidates, [&](Instruction *A, Instruction *B) {
+      if (A->getParent() != B->getParent())
+        return BlockIndex[A->getParent()] < BlockIndex[B->getParent()];
+      return A->comesBefore(B);
+    });
+  }
 
-  for (auto *Orig : OutSets[BB]) {
-    auto *Inst = Orig;
-    Changed = true;
-    auto *End = BB->getTerminator();
-    if (auto *Existing = checkBeforeMove(BB, Inst))
-      Inst = Existing;
-    else
-      Inst->moveBefore(End); // pointer form works in LLVM 22
+  // A copy at the end of BB can only replace the occurrences it dominates.
+  SmallVector<BasicBlock *, 16> Region;
+  for (BasicBlock *Succ : breadth_first(BB))
+    if (DT.dominates(BB, Succ))
+      Region.push_back(Succ);
 
-    for (BasicBlock *Succ : breadth_first(BB))
+  for (auto *Orig : Candidates) {
+    // Already part of a hoist found before: into BB for an equivalent
+    // instance, or into a block dominating BB, which takes it further up.
+    if (Claimed.count(Orig))
+      continue;
+    HoistCandidate C;
+    C.Target = BB;
+    C.Inst = Orig;
+    Instruction *Existing = checkBeforeMove(BB, Orig);
+    if (Existing)
+      C.Inst = Existing;
+    C.Source = C.Inst->getParent();
+
+    for (BasicBlock *Succ : Region)
       for (Instruction &I : *Succ)
-        if (I.isIdenticalTo(Inst) && &I != Inst) {
-          I.replaceAllUsesWith(Inst);
-          ToDelete.insert(&I);
-        }
+        if (&I != C.Inst && Equivalence.areEquivalent(&I, C.Inst))
+          C.Copies.push_back(&I);
+    // Already computed in BB with nothing to merge into it (BB only loops
+    // to itself): there is nothing to hoist.
+    if (Existing && C.Copies.empty())
+      continue;
+    // Moving the survivor up makes it execute on paths it did not before;
+    // merging copies into an existing instruction of BB does not.
+    if (!Existing && !isSafeToHoistTo(C.Inst, BB, DT, AC, LVI))
+      continue;
+    Claimed.insert(C.Inst);
+    Claimed.insert(C.Copies.begin(), C.Copies.end());
+    for (Instruction *I : C.Copies)
+      C.CopyBlocks.push_back(I->getParent());
+
+    // Ranked by the weighted cycles saved, as the what-if report estimates
+    // them.
+    if (TTI && BFI) {
+      SmallVector<const BasicBlock *, 4> Sources(C.CopyBlocks.begin(),
+                                                 C.CopyBlocks.end());
+      if (!Existing)
+        Sources.push_back(C.Source);
+      C.Benefit = weightedCyclesSaved(
+          costInCycles(TTI->getInstructionCost(
+              C.Inst, TargetTransformInfo::TCK_RecipThroughput)),
+          *BFI, BB, /*Moved=*/!Existing, Sources);
+    }
+    C.Order = Found.size();
+    Found.push_back(std::move(C));
+  }
+}
+
+unsigned HoistAnticipatedExpressionsPass::applyHoists(
+    std::vector<HoistCandidate> &Candidates, HoistBudget &Budget,
+    HoistCallback OnHoist) {
+  // Most valuable first; the loop depth of the target comes first in
+  // vectorization-friendly mode, and the order of discovery breaks ties.
+  auto Less = [&](unsigned A, unsigned B) {
+    const HoistCandidate &X = Candidates[A], &Y = Candidates[B];
+    return std::make_tuple(X.Tier, X.Benefit, Y.Order) <
+           std::make_tuple(Y.Tier, Y.Benefit, X.Order);
+  };
+  std::priority_queue<unsigned, std::vector<unsigned>, decltype(Less)> Queue(
+      Less);
+  for (unsigned I = 0, E = Candidates.size(); I != E; ++I)
+    Queue.push(I);
+
+  unsigned NumHoisted = 0;
+  std::set<Instruction *> ToDelete;
+  // A candidate is stale once a hoist before it moved or merged one of its
+  // instructions; the next iteration finds it again if it still applies.
+  auto IsStale = [&](const HoistCandidate &C) {
+    if (ToDelete.count(C.Inst) || C.Inst->getParent() != C.Source)
+      return true;
+    for (unsigned I = 0, E = C.Copies.size(); I != E; ++I)
+      if (ToDelete.count(C.Copies[I]) ||
+          C.Copies[I]->getParent() != C.CopyBlocks[I])
+        return true;
+    return false;
+  };
+
+  for (; !Queue.empty(); Queue.pop()) {
+    if (Budget.isExhausted())
+      break;
+    HoistCandidate &C = Candidates[Queue.top()];
+    if (IsStale(C) || !Budget.allowsInto(C.Target) ||
+        !shouldChange("hoist", C.Inst, C.Target))
+      continue;
+    Budget.recordHoist(C.Target, C.Source != C.Target);
+    ++NumHoisted;
+
+    Instruction *Inst = C.Inst;
+    SmallVector<BasicBlock *, 4> Sources;
+    SmallVector<Metadata *, 4> Provenance;
+    if (RecordProvenance)
+      appendProvenance(*Inst, Provenance);
+    TouchedBlocks.push_back(C.Target);
+    if (C.Source != C.Target) {
+      Sources.push_back(C.Source);
+      TouchedBlocks.push_back(C.Source);
+      Equivalence.forget(*Inst);
+      Inst->moveBefore(C.Target->getTerminator()); // pointer form works in LLVM 22
+    }
+
+    for (Instruction *I : C.Copies) {
+      if (RecordProvenance)
+        appendProvenance(*I, Provenance);
+      // The survivor now executes on behalf of every copy: give it the
+      // merged location so sample profiles do not charge one arm for the
+      // work of all of them. Debug records of the copy are redirected to the
+      // survivor by the RAUW, which dominates them.
+      Inst->applyMergedLocation(Inst->getDebugLoc(), I->getDebugLoc());
+      Equivalence.mergeInto(*Inst, *I);
+      Equivalence.forget(*I);
+      I->replaceAllUsesWith(Inst);
+      ToDelete.insert(I);
+      Sources.push_back(I->getParent());
+      TouchedBlocks.push_back(I->getParent());
+    }
+
+    if (RecordProvenance)
+      Inst->setMetadata("hoist.provenance",
+                        MDTuple::get(Inst->getContext(), Provenance));
+    if (isa<CmpInst>(Inst))
+      HoistedConditions.push_back(Inst);
+    if (OnHoist)
+      OnHoist(*Inst, *C.Target, C.Source != C.Target, Sources);
   }
 
   for (auto *I : ToDelete)
     I->eraseFromParent();
 
-  return Changed;
+  return NumHoisted;
 }
 
-PreservedAnalyses HoistAnticipatedExpressionsPass::run(Function &F,
-                                                       FunctionAnalysisManager &AM) {
-  const auto &TLI = AM.getResult<TargetLibraryAnalysis>(F);
+// The hoist that moves or merges each instruction, by index into the
+// candidates of one iteration, and what findPartner found so far.
+using HoistGroups = DenseMap<const Instruction *, unsigned>;
+using PartnerMap = DenseMap<const Instruction *, Instruction *>;
+
+static Instruction *findPartner(Instruction *I, const HoistGroups &Groups,
+                                ArrayRef<HoistCandidate> Candidates,
+                                function_ref<bool(Instruction *)> CanMove,
+                                PartnerMap &Partners);
+
+// Returns true if operands A and B are one value once the hoists of
+// Candidates are done.
+static bool isSameOperand(Value *A, Value *B, const HoistGroups &Groups,
+                          ArrayRef<HoistCandidate> Candidates,
+                          function_ref<bool(Instruction *)> CanMove,
+                          PartnerMap &Partners) {
+  if (A == B)
+    return true;
+  auto *IA = dyn_cast<Instruction>(A), *IB = dyn_cast<Instruction>(B);
+  if (!IA || !IB)
+    return false;
+  auto GA = Groups.find(IA), GB = Groups.find(IB);
+  if (GA != Groups.end() || GB != Groups.end())
+    return GA != Groups.end() && GB != Groups.end() &&
+           GA->second == GB->second;
+  return findPartner(IA, Groups, Candidates, CanMove, Partners) == IB;
+}
+
+// Returns the instruction of another block that I, which no hoist of
+// Candidates moves, becomes identical to once they are done: the same
+// operation on operands that are the same value then. Those are the next
+// links of the chains Candidates start to hoist. Null if there is none.
+static Instruction *findPartner(Instruction *I, const HoistGroups &Groups,
+                                ArrayRef<HoistCandidate> Candidates,
+                                function_ref<bool(Instruction *)> CanMove,
+                                PartnerMap &Partners) {
+  auto Memo = Partners.try_emplace(I, nullptr);
+  if (!Memo.second)
+    return Memo.first->second;
+  if (isa<PHINode>(I) || !CanMove(I))
+    return nullptr;
+  // The partner uses what an operand of I in its block becomes: the other
+  // instructions its hoist merges it with, or its own partner.
+  auto It = find_if(I->operands(), [&](Value *Op) {
+    auto *OpI = dyn_cast<Instruction>(Op);
+    return OpI && OpI->getParent() == I->getParent();
+  });
+  if (It == I->op_end())
+    return nullptr;
+  auto *Op = cast<Instruction>(*It);
+  SmallVector<Instruction *, 4> Merged;
+  auto G = Groups.find(Op);
+  if (G != Groups.end()) {
+    Merged.push_back(Candidates[G->second].Inst);
+    append_range(Merged, Candidates[G->second].Copies);
+  } else if (Instruction *P =
+                 findPartner(Op, Groups, Candidates, CanMove, Partners)) {
+    Merged.push_back(P);
+  }
+  for (Instruction *Other : Merged)
+    for (User *U : Other->users()) {
+      auto *J = dyn_cast<Instruction>(U);
+      if (!J || J->getParent() == I->getParent() || !J->isSameOperationAs(I))
+        continue;
+      bool Same = true;
+      for (unsigned K = 0, E = I->getNumOperands(); Same && K != E; ++K)
+        Same = isSameOperand(I->getOperand(K), J->getOperand(K), Groups,
+                             Candidates, CanMove, Partners);
+      if (Same)
+        return Partners[I] = J;
+    }
+  return nullptr;
+}
+
+// The loop vectorizer if-converts a loop body: a block that does not
+// dominate the latch is predicated, its instructions masked or blended.
+// Hoisting into the loop only pays off for it when a predicated block is
+// left with nothing but its terminator; otherwise the block is predicated all
+// the same and the hoisted instruction just executes more often. A block
+// empties when each of its instructions is moved or merged by a hoist found
+// in this iteration, or is the next link of a chain those hoists start,
+// hoisted in the iterations that follow. Hoists into a loop that empty no
+// predicated block are dropped, and the others rank by the loop depth of
+// their target, innermost loops first.
+void HoistAnticipatedExpressionsPass::selectVectorizationHoists(
+    std::vector<HoistCandidate> &Candidates, const DominatorTree &DT,
+    const LoopInfo &LI, const TargetLibraryInfo &TLI) {
+  HoistGroups Groups;
+  for (unsigned K = 0, E = Candidates.size(); K != E; ++K) {
+    Groups[Candidates[K].Inst] = K;
+    for (Instruction *I : Candidates[K].Copies)
+      Groups[I] = K;
+  }
+  auto CanMove = [&](Instruction *I) { return !isToBeIgnored(I, TLI); };
+  PartnerMap Partners;
+
+  DenseMap<const BasicBlock *, bool> Empties;
+  auto EmptiesPredicated = [&](BasicBlock *BB) {
+    auto Memo = Empties.find(BB);
+    if (Memo != Empties.end())
+      return Memo->second;
+    SmallVector<BasicBlock *, 4> Latches;
+    if (Loop *L = LI.getLoopFor(BB))
+      L->getLoopLatches(Latches);
+    bool Predicated = any_of(Latches, [&](BasicBlock *Latch) {
+      return !DT.dominates(BB, Latch);
+    });
+    bool Result = Predicated && all_of(*BB, [&](Instruction &I) {
+      return I.isTerminator() || Groups.count(&I) ||
+             findPartner(&I, Groups, Candidates, CanMove, Partners);
+    });
+    return Empties[BB] = Result;
+  };
+
+  std::vector<HoistCandidate> Selected;
+  for (HoistCandidate &C : Candidates) {
+    C.Tier = LI.getLoopDepth(C.Target);
+    if (!C.Tier || (C.Source != C.Target && EmptiesPredicated(C.Source)) ||
+        any_of(C.CopyBlocks, EmptiesPredicated))
+      Selected.push_back(C);
+  }
+  Candidates = std::move(Selected);
+}
+
+// Matches Outer(Inner(X)), the casts of an extension chain, against a single
+// cast of X to the type of Outer: sets X, and Op to the opcode of that cast
+// unless the chain is X itself. Returns false if there is none.
+static bool matchExtensionChain(const CastInst &Outer, Value *&X,
+                                std::optional<Instruction::CastOps> &Op) {
+  auto *Inner = dyn_cast<CastInst>(Outer.getOperand(0));
+  if (!Inner || !isa<ZExtInst, SExtInst>(Inner))
+    return false;
+  X = Inner->getOperand(0);
+  unsigned SrcBits = X->getType()->getScalarSizeInBits();
+  unsigned DestBits = Outer.getType()->getScalarSizeInBits();
+  switch (Outer.getOpcode()) {
+  case Instruction::ZExt:
+    // sext(x) has its sign bit set whenever x has; zext of it is no plain
+    // extension of x.
+    if (!isa<ZExtInst>(Inner))
+      return false;
+    [[fallthrough]];
+  case Instruction::SExt:
+    Op = Inner->getOpcode();
+    return true;
+  case Instruction::Trunc:
+    if (DestBits < SrcBits)
+      Op = Instruction::Trunc;
+    else if (DestBits > SrcBits)
+      Op = Inner->getOpcode();
+    else
+      Op = std::nullopt;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Returns true if N cannot wrap on the operands it has, so that Ext(N) is the
+// operation of N performed on the operands extended with Ext. Bitwise
+// operations never wrap; for the others a no-wrap flag or known bits must
+// say so.
+static bool canWidenThrough(const BinaryOperator &N, Instruction::CastOps Ext,
+                            const SimplifyQuery &SQ) {
+  Value *X = N.getOperand(0), *Y = N.getOperand(1);
+  bool Unsigned = Ext == Instruction::ZExt;
+  OverflowResult Overflow;
+  switch (N.getOpcode()) {
+  case Instruction::And:
+  case Instruction::Or:
+  case Instruction::Xor:
+    return true;
+  case Instruction::Add:
+    Overflow = Unsigned ? computeOverflowForUnsignedAdd(X, Y, SQ)
+                        : computeOverflowForSignedAdd(X, Y, SQ);
+    break;
+  case Instruction::Sub:
+    Overflow = Unsigned ? computeOverflowForUnsignedSub(X, Y, SQ)
+                        : computeOverflowForSignedSub(X, Y, SQ);
+    break;
+  case Instruction::Mul:
+    Overflow = Unsigned ? computeOverflowForUnsignedMul(X, Y, SQ)
+                        : computeOverflowForSignedMul(X, Y, SQ);
+    break;
+  default:
+    return false;
+  }
+  return (Unsigned ? N.hasNoUnsignedWrap() : N.hasNoSignedWrap()) ||
+         Overflow == OverflowResult::NeverOverflows;
+}
+
+// How many operations deep widenCasts matches a narrow expression against a
+// wide one.
+static constexpr unsigned MaxWidenDepth = 4;
+
+// How many wide operations of the right opcode and type widenCasts tries to
+// match one extension against. Without a bound, a block of extensions next to
+// a block of unrelated wide arithmetic costs the product of the two.
+static constexpr unsigned MaxWideFormsScanned = 64;
+
+static bool isWidenedForm(Value *Narrow, Value *Wide, Instruction::CastOps Ext,
+                          const SimplifyQuery &SQ, unsigned Depth);
+
+// Returns true if the operands of W are those of N extended with Ext, the
+// first operand of N being the second of W if Swapped.
+static bool matchWidenedOperands(BinaryOperator &N, BinaryOperator &W,
+                                 Instruction::CastOps Ext,
+                                 const SimplifyQuery &SQ, unsigned Depth,
+                                 bool &Swapped) {
+  for (Swapped = false;; Swapped = true) {
+    if (isWidenedForm(N.getOperand(Swapped), W.getOperand(0), Ext, SQ, Depth) &&
+        isWidenedForm(N.getOperand(!Swapped), W.getOperand(1), Ext, SQ,
+                      Depth))
+      return true;
+    if (Swapped || !N.isCommutative())
+      return false;
+  }
+}
+
+// Returns true if Wide computes Ext(Narrow): it is that extension, or it
+// performs the operations of Narrow, up to Depth deep, on operands that are.
+static bool isWidenedForm(Value *Narrow, Value *Wide, Instruction::CastOps Ext,
+                          const SimplifyQuery &SQ, unsigned Depth) {
+  if (auto *C = dyn_cast<Constant>(Narrow))
+    return Wide == ConstantFoldCastOperand(Ext, C, Wide->getType(), SQ.DL);
+  auto *Cast = dyn_cast<CastInst>(Wide);
+  if (Cast && Cast->getOpcode() == Ext && Cast->getOperand(0) == Narrow)
+    return true;
+  auto *N = dyn_cast<BinaryOperator>(Narrow);
+  auto *W = dyn_cast<BinaryOperator>(Wide);
+  bool Swapped;
+  return Depth && N && W && N->getOpcode() == W->getOpcode() &&
+         canWidenThrough(*N, Ext, SQ) &&
+         matchWidenedOperands(*N, *W, Ext, SQ, Depth - 1, Swapped);
+}
+
+// Returns true if a hoist can merge A with a copy of it placed at B: one
+// dominates the other, or they sit in the same block or in blocks with the
+// same predecessors, like the arms of one branch. Elsewhere the rewrite would
+// only add instructions.
+static bool canMerge(const Instruction &A, const Instruction &B,
+                     const DominatorTree &DT) {
+  const BasicBlock *BlockA = A.getParent(), *BlockB = B.getParent();
+  if (BlockA == BlockB || DT.dominates(&A, &B) || DT.dominates(&B, &A))
+    return true;
+  SmallPtrSet<const BasicBlock *, 4> PredsA(pred_begin(BlockA),
+                                            pred_end(BlockA));
+  SmallPtrSet<const BasicBlock *, 4> PredsB(pred_begin(BlockB),
+                                            pred_end(BlockB));
+  return !PredsA.empty() && PredsA.size() == PredsB.size() &&
+         set_is_subset(PredsA, PredsB);
+}
+
+// Builds a copy of Wide, which isWidenedForm matched against Narrow, that
+// computes Ext(Narrow) from the operands of Narrow.
+static Value *buildWidenedForm(Value *Narrow, Value *Wide,
+                               Instruction::CastOps Ext,
+                               const SimplifyQuery &SQ, unsigned Depth,
+                               IRBuilder<> &Builder) {
+  if (isa<Constant>(Narrow))
+    return Wide;
+  auto *Cast = dyn_cast<CastInst>(Wide);
+  if (Cast && Cast->getOpcode() == Ext && Cast->getOperand(0) == Narrow)
+    return Builder.CreateCast(Ext, Narrow, Wide->getType(),
+                              Narrow->getName() + ".wide");
+  auto *N = cast<BinaryOperator>(Narrow);
+  auto *W = cast<BinaryOperator>(Wide);
+  bool Swapped;
+  matchWidenedOperands(*N, *W, Ext, SQ, Depth - 1, Swapped);
+  Value *X = buildWidenedForm(N->getOperand(Swapped), W->getOperand(0), Ext,
+                              SQ, Depth - 1, Builder);
+  Value *Y = buildWidenedForm(N->getOperand(!Swapped), W->getOperand(1), Ext,
+                              SQ, Depth - 1, Builder);
+  Value *V = Builder.CreateBinOp(N->getOpcode(), X, Y, N->getName() + ".wide");
+  // N does not wrap, so neither does the wide operation; a zero-extended
+  // result also fits the sign bit of the wider type.
+  if (auto *New = dyn_cast<BinaryOperator>(V))
+    if (isa<OverflowingBinaryOperator>(New)) {
+      New->setHasNoSignedWrap(true);
+      New->setHasNoUnsignedWrap(Ext == Instruction::ZExt);
+    }
+  return V;
+}
+
+// Narrow-type code spells the same value in different ways: zext(a) +
+// zext(b) in one block, zext(a + b) with nuw in another, or an extension
+// chain where another block extends once. Each of these is a different
+// instruction tree, so the dataflow never sees the two as one expression.
+// This folds an extension chain into the single cast F computes elsewhere (or
+// into its source), and rewrites an extension of narrow arithmetic that cannot
+// wrap into the wide arithmetic found elsewhere in F, operation by operation,
+// so the copies become identical and are hoisted as usual. Casts and wide
+// forms that nothing computes are not created: they would only add
+// instructions. Neither are wide forms that no hoist can merge with the
+// rewritten copy, nor, in vectorization-friendly mode (\p Loops), wide forms
+// inside a loop. Each rewrite counts against \p Budget. Returns the number of
+// casts rewritten.
+unsigned HoistAnticipatedExpressionsPass::widenCasts(
+    Function &F, const DominatorTree &DT, const TargetLibraryInfo &TLI,
+    const LoopInfo *Loops, HoistBudget &Budget) {
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  SmallVector<WeakVH, 16> Casts;
+  DenseSet<std::tuple<unsigned, Value *, Type *>> CastForms;
+  DenseMap<std::pair<unsigned, Type *>, SmallVector<WeakVH, 4>> WideForms;
+  for (BasicBlock *BB : post_order(&F.getEntryBlock()))
+    for (Instruction &I : *BB) {
+      if (isa<ZExtInst, SExtInst, TruncInst>(I)) {
+        Casts.push_back(&I);
+        CastForms.insert({I.getOpcode(), I.getOperand(0), I.getType()});
+      } else if (isa<BinaryOperator>(I))
+        WideForms[{I.getOpcode(), I.getType()}].push_back(&I);
+    }
+
+  // Only a value created for the rewrite inherits the name of I.
+  auto Replace = [&](Instruction &I, Value *V, bool Created) {
+    TouchedBlocks.push_back(I.getParent());
+    Budget.recordRewrite();
+    if (Created && isa<Instruction>(V) && !V->hasName())
+      V->takeName(&I);
+    I.replaceAllUsesWith(V);
+    RecursivelyDeleteTriviallyDeadInstructions(
+        &I, &TLI, nullptr,
+        [&](Value *Dead) { Equivalence.forget(*cast<Instruction>(Dead)); });
+  };
+
+  unsigned NumRewritten = 0;
+  for (WeakVH &VH : Casts) {
+    auto *Ext = dyn_cast_or_null<CastInst>(VH);
+    if (!Ext)
+      continue;
+    if (Budget.isExhausted())
+      break;
+    IRBuilder<> Builder(Ext);
+    Value *X;
+    std::optional<Instruction::CastOps> Op;
+    if (matchExtensionChain(*Ext, X, Op)) {
+      if ((Op && !CastForms.count({*Op, X, Ext->getType()})) ||
+          !shouldChange("cast", Ext))
+        continue;
+      Replace(*Ext, Op ? Builder.CreateCast(*Op, X, Ext->getType()) : X,
+              /*Created=*/Op.has_value());
+      ++NumRewritten;
+      continue;
+    }
+    auto *N = dyn_cast<BinaryOperator>(Ext->getOperand(0));
+    if (!N || isa<TruncInst>(Ext) ||
+        (Loops && Loops->getLoopFor(Ext->getParent())))
+      continue;
+    auto Opcode = Ext->getOpcode();
+    SimplifyQuery SQ(DL, &DT, AC, Ext);
+    if (!canWidenThrough(*N, Opcode, SQ))
+      continue;
+    auto It = WideForms.find({N->getOpcode(), Ext->getType()});
+    if (It == WideForms.end())
+      continue;
+    for (const WeakVH &Candidate :
+         ArrayRef<WeakVH>(It->second).take_front(MaxWideFormsScanned)) {
+      auto *W = dyn_cast_or_null<BinaryOperator>(Candidate);
+      if (!W || !canMerge(*W, *Ext, DT) ||
+          !isWidenedForm(N, W, Opcode, SQ, MaxWidenDepth))
+        continue;
+      if (!shouldChange("cast", Ext))
+        break;
+      Replace(*Ext, buildWidenedForm(N, W, Opcode, SQ, MaxWidenDepth, Builder),
+              /*Created=*/true);
+      ++NumRewritten;
+      break;
+    }
+  }
+  return NumRewritten;
+}
+
+// A select of two computations is a diamond SimplifyCFG has flattened: both
+// arms execute, so there is nothing to hoist, but the redundancy is still
+// there. Equivalent arms make the select one of them. Arms performing the
+// same operation on different operands, each used only by the select, become
+// one operation on selects of the differing operands, when the target cost
+// model says one copy of the operation costs more than the extra selects.
+// New selects are visited too, so whole operand trees are merged bottom-up
+// from the select.
+unsigned HoistAnticipatedExpressionsPass::foldSelectArms(
+    Function &F, const TargetLibraryInfo &TLI) {
+  SmallVector<WeakVH, 16> Worklist;
+  for (BasicBlock *BB : post_order(&F.getEntryBlock()))
+    for (Instruction &I : *BB)
+      if (isa<SelectInst>(I))
+        Worklist.push_back(&I);
+
+  auto IsArm = [&](Value *V) {
+    auto *I = dyn_cast<Instruction>(V);
+    return I && !isa<PHINode>(I) && !isToBeIgnored(I, TLI) ? I : nullptr;
+  };
+  auto Erase = [&](Instruction *I) {
+    TouchedBlocks.push_back(I->getParent());
+    RecursivelyDeleteTriviallyDeadInstructions(
+        I, &TLI, nullptr,
+        [&](Value *V) { Equivalence.forget(*cast<Instruction>(V)); });
+  };
+
+  unsigned NumFolded = 0;
+  while (!Worklist.empty()) {
+    auto *SI = dyn_cast_or_null<SelectInst>(Worklist.pop_back_val());
+    if (!SI)
+      continue;
+    Instruction *A = IsArm(SI->getTrueValue());
+    Instruction *B = IsArm(SI->getFalseValue());
+    if (!A || !B)
+      continue;
+
+    if (Equivalence.areEquivalent(A, B)) {
+      if (!shouldChange("select", SI))
+        continue;
+      Equivalence.mergeInto(*A, *B);
+      SI->replaceAllUsesWith(A);
+      Erase(SI);
+      ++NumFolded;
+      continue;
+    }
+
+    // Dividing by a select of divisors would trap whenever the condition
+    // is poison, where the select of two divisions was just poison.
+    if (A == B || !A->hasOneUse() || !B->hasOneUse() ||
+        !A->isSameOperationAs(B) || isDivRem(A) ||
+        !(isa<BinaryOperator>(A) || isa<CastInst>(A) || isa<CmpInst>(A)))
+      continue;
+    SmallVector<unsigned, 2> Differing;
+    bool Valid = true;
+    for (unsigned Op = 0, E = A->getNumOperands(); Op != E; ++Op) {
+      Value *X = A->getOperand(Op), *Y = B->getOperand(Op);
+      auto *XI = dyn_cast<Instruction>(X), *YI = dyn_cast<Instruction>(Y);
+      if (X == Y || (XI && YI && Equivalence.areEquivalent(XI, YI)))
+        continue;
+      Valid &= !SelectInst::areInvalidOperands(SI->getCondition(), X, Y);
+      Differing.push_back(Op);
+    }
+    if (!Valid || Differing.empty())
+      continue;
+
+    // One copy of the operation goes; every differing operand but the first
+    // needs a select of its own.
+    InstructionCost Saved = 1, Added = 0;
+    if (TTI) {
+      auto Kind = TargetTransformInfo::TCK_RecipThroughput;
+      Saved = TTI->getInstructionCost(A, Kind);
+      for (unsigned K = 1; K < Differing.size(); ++K)
+        Added += TTI->getInstructionCost(SI, Kind);
+    } else if (Differing.size() > 1) {
+      continue;
+    }
+    if (!Saved.isValid() || !Added.isValid() || Saved <= Added ||
+        !shouldChange("select", SI))
+      continue;
+
+    IRBuilder<> Builder(SI);
+    Instruction *Merged = A->clone();
+    Merged->andIRFlags(B);
+    for (unsigned Op = 0, E = A->getNumOperands(); Op != E; ++Op) {
+      Value *X = A->getOperand(Op), *Y = B->getOperand(Op);
+      if (X == Y)
+        continue;
+      if (!is_contained(Differing, Op)) {
+        Equivalence.mergeInto(*cast<Instruction>(X), *cast<Instruction>(Y));
+        continue;
+      }
+      Value *Sel = Builder.CreateSelect(SI->getCondition(), X, Y,
+                                        SI->getName() + ".arm", SI);
+      Merged->setOperand(Op, Sel);
+      Worklist.push_back(Sel);
+    }
+    Builder.Insert(Merged);
+    Merged->takeName(SI);
+    Merged->applyMergedLocation(A->getDebugLoc(), B->getDebugLoc());
+    SI->replaceAllUsesWith(Merged);
+    for (User *U : Merged->users())
+      if (isa<SelectInst>(U))
+        Worklist.push_back(U);
+    Erase(SI);
+    ++NumFolded;
+  }
+  return NumFolded;
+}
+
+// Merging the comparisons of sibling blocks leaves branches on the same
+// condition below one another. Wherever an edge of a branch on a hoisted
+// comparison dominates another use of it, the use gets the value the edge
+// implies; branches that become constant are folded and the blocks they no
+// longer reach are deleted. Returns the number of uses replaced. This changes
+// the CFG, so it runs last, tells LazyValueInfo about deleted blocks and
+// keeps DT up to date.
+unsigned HoistAnticipatedExpressionsPass::foldDominatedBranches(
+    Function &F, DominatorTree &DT) {
+  unsigned NumReplaced = 0;
+  SmallVector<WeakVH, 8> Branches;
+  for (WeakVH &VH : HoistedConditions) {
+    auto *Cond = dyn_cast_or_null<CmpInst>(VH);
+    if (!Cond)
+      continue;
+    SmallVector<BranchInst *, 4> Deciding;
+    for (User *U : Cond->users())
+      if (auto *BI = dyn_cast<BranchInst>(U))
+        if (BI->isConditional() && BI->getSuccessor(0) != BI->getSuccessor(1))
+          Deciding.push_back(BI);
+    Branches.append(Deciding.begin(), Deciding.end());
+    for (BranchInst *BI : Deciding) {
+      // Already decided by a branch above it.
+      if (BI->getCondition() != Cond || !shouldChange("branch", BI))
+        continue;
+      for (unsigned S = 0; S != 2; ++S) {
+        BasicBlockEdge Edge(BI->getParent(), BI->getSuccessor(S));
+        Constant *Known = S == 0 ? ConstantInt::getTrue(Cond->getType())
+                                 : ConstantInt::getFalse(Cond->getType());
+        NumReplaced += replaceDominatedUsesWith(Cond, Known, DT, Edge);
+      }
+    }
+  }
+  if (!NumReplaced)
+    return 0;
+
+  DomTreeUpdater DTU(DT, DomTreeUpdater::UpdateStrategy::Lazy);
+  for (WeakVH &VH : Branches)
+    if (auto *BI = dyn_cast_or_null<BranchInst>(VH))
+      if (isa<Constant>(BI->getCondition())) {
+        BasicBlock *BB = BI->getParent();
+        TouchedBlocks.push_back(BB);
+        for (BasicBlock *Succ : successors(BB))
+          TouchedBlocks.push_back(Succ);
+        ConstantFoldTerminator(BB, /*DeleteDeadConditions=*/false,
+                               /*TLI=*/nullptr, &DTU);
+      }
+  SmallPtrSet<BasicBlock *, 32> Reachable;
+  for (BasicBlock *BB : depth_first(&F.getEntryBlock()))
+    Reachable.insert(BB);
+  for (BasicBlock &BB : F) {
+    if (Reachable.count(&BB))
+      continue;
+    if (LVI)
+      LVI->eraseBlock(&BB);
+    // Their phis lose the incoming values of the deleted block.
+    for (BasicBlock *Succ : successors(&BB))
+      if (Reachable.count(Succ))
+        TouchedBlocks.push_back(Succ);
+  }
+  removeUnreachableBlocks(F, &DTU);
+  DTU.flush();
+  return NumReplaced;
+}
+
+void HoistAnticipatedExpressionsPass::computeUseDefSets(
+    Function &F, const TargetLibraryInfo &TLI,
+    std::map<BasicBlock *, std::set<Instruction *>> &UseSets,
+    std::map<BasicBlock *, std::set<Instruction *>> &DefSets) {
+  for (BasicBlock *BB : post_order(&F.getEntryBlock())) {
+    findUseSet(BB, UseSets, TLI);
+    findDefSet(BB, DefSets);
+  }
+}
+
+void HoistAnticipatedExpressionsPass::computeInOutSets(
+    Function &F, const DominatorTree &DT,
+    std::map<BasicBlock *, std::set<Instruction *>> &UseSets,
+    std::map<BasicBlock *, std::set<Instruction *>> &DefSets,
+    std::map<BasicBlock *, std::set<Instruction *>> &InSets,
+    std::map<BasicBlock *, std::set<Instruction *>> &OutSets) {
+  for (BasicBlock *BB : post_order(&F.getEntryBlock())) {
+    // A self-loop makes Out[BB] depend on In[BB]. Seeding In[BB] with the
+    // expressions of BB itself before the meet reaches the fixpoint in one
+    // pass, as Out[BB] cannot add anything to In[BB] that BB does not compute.
+    if (is_contained(successors(BB), BB))
+      findInSet(BB, UseSets, DefSets, InSets, OutSets);
+    findOutSet(BB, DT, UseSets, DefSets, InSets, OutSets);
+    findInSet(BB, UseSets, DefSets, InSets, OutSets);
+  }
+}
 
+unsigned HoistAnticipatedExpressionsPass::hoistAnticipatedExpressions(
+    Function &F, const TargetLibraryInfo &TLI, HoistCallback OnHoist) {
+  // With -time-trace every function, outer iteration and phase shows up as a
+  // nested event; set sizes and hoist counts are attached as event details.
+  TimeTraceScope FunctionScope("HoistAnticipatedExpressions", F.getName());
+  PerfCounters *Counters = getPerfCounters();
+  PhaseCounterTotals CounterTotals = {};
+  HoistBudget Budget;
+  // Hoisting never changes the CFG; only the branch folding at the end does.
+  DominatorTree DT(F);
+  HoistedConditions.clear();
+  TouchedBlocks.clear();
+
+  std::optional<LoopInfo> Loops;
+  if (VectorizeFriendly)
+    Loops.emplace(DT);
+
+  unsigned NumWidened = 0;
+  if (WidenCasts) {
+    TimeTraceScope PhaseScope("HoistAnticipatedExpressions.Casts");
+    NumWidened = widenCasts(F, DT, TLI, Loops ? &*Loops : nullptr, Budget);
+  }
+
+  unsigned Iteration = 0;
+  unsigned TotalHoisted = 0;
   bool Changed = true;
   while (Changed) {
+    TimeTraceScope IterationScope("HoistAnticipatedExpressions.Iteration", [&] {
+      return F.getName().str() + " #" + std::to_string(Iteration);
+    });
     Changed = false;
     std::map<BasicBlock *, std::set<Instruction *>> InSets, OutSets, UseSets, DefSets;
 
-    for (BasicBlock *BB : post_order(&F.getEntryBlock())) {
-      findUseSet(BB, UseSets, TLI);
-      findDefSet(BB, DefSets);
-      findOutSet(BB, UseSets, DefSets, InSets, OutSets);
-      findInSet(BB, UseSets, DefSets, InSets, OutSets);
+    {
+      TimeTraceScope PhaseScope("HoistAnticipatedExpressions.UseDef", [&] {
+        return "blocks=" + std::to_string(F.size());
+      });
+      PhaseCounterScope CounterScope(Counters, CounterTotals[UseDefPhase]);
+      computeUseDefSets(F, TLI, UseSets, DefSets);
     }
 
-    for (BasicBlock *BB : breadth_first(&F.getEntryBlock()))
-      if (hoistInstructions(BB, OutSets)) {
-        Changed = true;
-        break;
-      }
+    {
+      TimeTraceScope PhaseScope("HoistAnticipatedExpressions.Dataflow", [&] {
+        return "use=" + std::to_string(totalSetSize(UseSets)) +
+               " def=" + std::to_string(totalSetSize(DefSets));
+      });
+      PhaseCounterScope CounterScope(Counters, CounterTotals[DataflowPhase]);
+      computeInOutSets(F, DT, UseSets, DefSets, InSets, OutSets);
+    }
+
+    if (VerifyDataflow) {
+      std::string Mismatch = checkAnticipationSets(
+          F, DT, Equivalence,
+          [&](Instruction *I) { return !isToBeIgnored(I, TLI); }, InSets,
+          OutSets);
+      if (!Mismatch.empty())
+        report_fatal_error("hoist-anticipated-expressions: dataflow differs "
+                           "from the reference solver: " +
+                           Twine(Mismatch));
+    }
+
+    unsigned NumHoisted = 0;
+    {
+      TimeTraceScope PhaseScope("HoistAnticipatedExpressions.Hoist", [&] {
+        return "in=" + std::to_string(totalSetSize(InSets)) +
+               " out=" + std::to_string(totalSetSize(OutSets));
+      });
+      PhaseCounterScope CounterScope(Counters, CounterTotals[HoistPhase]);
+      // Dominators come before the blocks they dominate in breadth-first
+      // order, so an expression is hoisted as far up as it is anticipated.
+      std::vector<HoistCandidate> Candidates;
+      SmallPtrSet<Instruction *, 32> Claimed;
+      for (BasicBlock *BB : breadth_first(&F.getEntryBlock()))
+        findHoistCandidates(BB, DT, OutSets, Claimed, Candidates);
+      if (Loops)
+        selectVectorizationHoists(Candidates, DT, *Loops, TLI);
+      NumHoisted = applyHoists(Candidates, Budget, OnHoist);
+      Changed = NumHoisted && !Budget.isExhausted();
+    }
+
+    TotalHoisted += NumHoisted;
+    timeTraceAddInstantEvent("HoistAnticipatedExpressions.Hoisted", [&] {
+      return F.getName().str() + " #" + std::to_string(Iteration) +
+             " hoisted=" + std::to_string(NumHoisted);
+    });
+    ++Iteration;
+  }
+
+  unsigned NumFolded = 0;
+  if (FoldSelectArms) {
+    TimeTraceScope PhaseScope("HoistAnticipatedExpressions.Selects");
+    NumFolded = foldSelectArms(F, TLI);
+  }
+
+  unsigned NumDecided = 0;
+  if (FoldBranches) {
+    TimeTraceScope PhaseScope("HoistAnticipatedExpressions.Branches");
+    NumDecided = foldDominatedBranches(F, DT);
   }
 
+  if (VerifyTouched) {
+    TimeTraceScope PhaseScope("HoistAnticipatedExpressions.Verify");
+    SmallVector<BasicBlock *, 16> Blocks;
+    for (WeakVH &VH : TouchedBlocks)
+      if (auto *BB = cast_or_null<BasicBlock>(VH))
+        Blocks.push_back(BB);
+    std::string Problem = verifyTouchedBlocks(F, DT, Blocks);
+    if (!Problem.empty())
+      report_fatal_error("hoist-anticipated-expressions: broken " +
+                         Twine(Problem));
+  }
+
+  timeTraceAddInstantEvent("HoistAnticipatedExpressions.Summary", [&] {
+    return F.getName().str() + " iterations=" + std::to_string(Iteration) +
+           " widened=" + std::to_string(NumWidened) +
+           " hoisted=" + std::to_string(TotalHoisted) +
+           " selects=" + std::to_string(NumFolded) +
+           " decided=" + std::to_string(NumDecided);
+  });
+  if (Counters)
+    printPhaseCounters(F, *Counters, CounterTotals);
+
+  return TotalHoisted;
+}
+
+// Expressions are identical instructions, and unless
+// -hoist-anticipated-scev-equivalence=false those with the same SCEV.
+void HoistAnticipatedExpressionsPass::setAnalyses(
+    Function &F, FunctionAnalysisManager &FAM) {
+  Equivalence = ExpressionEquivalence(
+      UseSCEVEquivalence ? &FAM.getResult<ScalarEvolutionAnalysis>(F)
+                         : nullptr);
+  AC = &FAM.getResult<AssumptionAnalysis>(F);
+  BFI = &FAM.getResult<BlockFrequencyAnalysis>(F);
+  LVI = &FAM.getResult<LazyValueAnalysis>(F);
+  TTI = &FAM.getResult<TargetIRAnalysis>(F);
+}
+
+PreservedAnalyses HoistAnticipatedExpressionsPass::run(Function &F,
+                                                       FunctionAnalysisManager &AM) {
+  const auto &TLI = AM.getResult<TargetLibraryAnalysis>(F);
+  setAnalyses(F, AM);
+  hoistAnticipatedExpressions(F, TLI);
   return PreservedAnalyses::none();
 }
 
+// Called for every simulated hoist with the hoisted instruction of the clone,
+// the instruction of F it was cloned from, and the target and source blocks
+// mapped back to F.
+using SimulatedHoistCallback =
+    function_ref<void(Instruction &Hoisted, const Instruction &Orig,
+                      const BasicBlock &Target, bool Moved,
+                      ArrayRef<const BasicBlock *> Sources)>;
+
+// Runs the real transformation on a throw-away clone of F: hoists that only
+// become visible after earlier ones are seen too, and F is untouched. Hoists
+// are reported before any branch is folded, so every clone block they name
+// maps back to F.
+static unsigned simulateHoists(Function &F, FunctionAnalysisManager &FAM,
+                               SimulatedHoistCallback OnHoist) {
+  ValueToValueMapTy VMap;
+  Function *Clone = CloneFunction(&F, VMap);
+  std::map<const Value *, const Value *> Original;
+  for (auto KV : VMap)
+    Original[KV.second] = KV.first;
+  auto OrigBlock = [&](const BasicBlock *BB) {
+    return cast<BasicBlock>(Original[BB]);
+  };
+
+  HoistAnticipatedExpressionsPass Hoister;
+  Hoister.setAnalyses(*Clone, FAM);
+  const auto &TLI = FAM.getResult<TargetLibraryAnalysis>(*Clone);
+  unsigned NumHoisted = Hoister.hoistAnticipatedExpressions(
+      *Clone, TLI,
+      [&](Instruction &Inst, BasicBlock &Target, bool Moved,
+          ArrayRef<BasicBlock *> Sources) {
+        SmallVector<const BasicBlock *, 4> OrigSources;
+        for (BasicBlock *Source : Sources)
+          OrigSources.push_back(OrigBlock(Source));
+        // Instructions the pass created itself (widened casts) have no
+        // original; they are reported as they are in the clone.
+        auto *Orig = cast_or_null<Instruction>(Original[&Inst]);
+        OnHoist(Inst, Orig ? *Orig : Inst, *OrigBlock(&Target), Moved,
+                OrigSources);
+      });
+
+  FAM.clear(*Clone, Clone->getName());
+  Clone->eraseFromParent();
+  return NumHoisted;
+}
+
+PreservedAnalyses
+HoistAnticipatedExpressionsReportPass::run(Module &M, ModuleAnalysisManager &AM) {
+  auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  unsigned ModuleHoists = 0;
+  double ModuleSaved = 0.0;
+
+  SmallVector<Function *, 16> Worklist;
+  for (Function &F : M)
+    if (!F.isDeclaration())
+      Worklist.push_back(&F);
+
+  for (Function *F : Worklist) {
+    auto &BFI = FAM.getResult<BlockFrequencyAnalysis>(*F);
+    auto &TTI = FAM.getResult<TargetIRAnalysis>(*F);
+
+    auto PrintBlock = [&](const BasicBlock *BB) {
+      BB->printAsOperand(OS, /*PrintType=*/false);
+      OS << " (freq " << format("%.2f", relativeFrequency(BFI, BB)) << ")";
+    };
+
+    unsigned FunctionHoists = 0;
+    double FunctionSaved = 0.0;
+    OS << "Hoist report for function '" << F->getName() << "':\n";
+    simulateHoists(
+        *F, FAM,
+        [&](Instruction &Inst, const Instruction &Orig, const BasicBlock &Target,
+            bool Moved, ArrayRef<const BasicBlock *> Sources) {
+          double Cost = costInCycles(
+              TTI.getInstructionCost(&Inst, TargetTransformInfo::TCK_RecipThroughput));
+          double Saved = weightedCyclesSaved(Cost, BFI, &Target, Moved, Sources);
+
+          OS << Orig << "\n    into ";
+          PrintBlock(&Target);
+          OS << " from ";
+          ListSeparator LS;
+          for (const BasicBlock *Source : Sources) {
+            OS << LS;
+            PrintBlock(Source);
+          }
+          OS << "\n    cost " << format("%.0f", Cost) << ", saved "
+             << format("%.2f", Saved) << " weighted cycles\n";
+          ++FunctionHoists;
+          FunctionSaved += Saved;
+        });
+    OS << "  function total: " << FunctionHoists << " hoists, "
+       << format("%.2f", FunctionSaved) << " weighted cycles saved\n";
+
+    ModuleHoists += FunctionHoists;
+    ModuleSaved += FunctionSaved;
+  }
+
+  OS << "Module total: " << ModuleHoists << " hoists, "
+     << format("%.2f", ModuleSaved) << " weighted cycles saved\n";
+  return PreservedAnalyses::all();
+}
+
+using HoistedExpressions = std::map<const BasicBlock *, std::vector<std::string>>;
+
+static void
+writeAnticipationGraph(raw_ostream &OS, Function &F,
+                       const BlockFrequencyInfo &BFI,
+                       std::map<BasicBlock *, std::set<Instruction *>> &InSets,
+                       std::map<BasicBlock *, std::set<Instruction *>> &OutSets,
+                       const HoistedExpressions &HoistedIn,
+                       const HoistedExpressions &HoistedOut) {
+  bool Summarize = F.size() > DotSummaryBlocks;
+  uint64_t MaxFreq = getMaxFreq(F, &BFI);
+
+  OS << "digraph \"Anticipated expressions for '"
+     << DOT::EscapeString(F.getName().str()) << "' function\" {\n";
+  OS << "  label=\"Anticipated expressions for '"
+     << DOT::EscapeString(F.getName().str()) << "' function"
+     << (Summarize ? " (summarized)" : "") << "\";\n";
+  OS << "  node [shape=box, style=filled, fontname=Courier];\n";
+
+  for (BasicBlock &BB : F) {
+    std::string Name;
+    raw_string_ostream NameOS(Name);
+    BB.printAsOperand(NameOS, /*PrintType=*/false);
+
+    std::string Label;
+    raw_string_ostream LabelOS(Label);
+    LabelOS << DOT::EscapeString(NameOS.str()) << " (freq "
+            << format("%.2f", relativeFrequency(BFI, &BB)) << ")\\l"
+            << "in " << InSets[&BB].size() << ", out " << OutSets[&BB].size()
+            << "\\l";
+    auto PrintHoists = [&](StringRef What, const HoistedExpressions &Hoists) {
+      auto It = Hoists.find(&BB);
+      if (It == Hoists.end())
+        return;
+      LabelOS << What << ": " << It->second.size() << "\\l";
+      if (!Summarize)
+        for (const std::string &Expr : It->second)
+          LabelOS << "  " << DOT::EscapeString(Expr) << "\\l";
+    };
+    PrintHoists("hoisted in", HoistedIn);
+    PrintHoists("hoisted out", HoistedOut);
+
+    OS << "  Node" << static_cast<const void *>(&BB) << " [label=\""
+       << LabelOS.str() << "\", fillcolor=\""
+       << getHeatColor(BFI.getBlockFreq(&BB).getFrequency(), MaxFreq)
+       << "\"];\n";
+    for (BasicBlock *Succ : successors(&BB))
+      OS << "  Node" << static_cast<const void *>(&BB) << " -> Node"
+         << static_cast<const void *>(Succ) << ";\n";
+  }
+  OS << "}\n";
+}
+
+PreservedAnalyses
+DOTAnticipatedExpressionsPass::run(Module &M, ModuleAnalysisManager &AM) {
+  auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+
+  SmallVector<Function *, 16> Worklist;
+  for (Function &F : M)
+    if (!F.isDeclaration())
+      Worklist.push_back(&F);
+
+  for (Function *F : Worklist) {
+    auto &BFI = FAM.getResult<BlockFrequencyAnalysis>(*F);
+    auto &DT = FAM.getResult<DominatorTreeAnalysis>(*F);
+    const auto &TLI = FAM.getResult<TargetLibraryAnalysis>(*F);
+
+    // The sets as the pass sees them before its first hoist.
+    HoistAnticipatedExpressionsPass Hoister;
+    Hoister.setAnalyses(*F, FAM);
+    std::map<BasicBlock *, std::set<Instruction *>> InSets, OutSets, UseSets,
+        DefSets;
+    Hoister.computeUseDefSets(*F, TLI, UseSets, DefSets);
+    Hoister.computeInOutSets(*F, DT, UseSets, DefSets, InSets, OutSets);
+
+    HoistedExpressions HoistedIn, HoistedOut;
+    simulateHoists(*F, FAM,
+                   [&](Instruction &, const Instruction &Orig,
+                       const BasicBlock &Target, bool,
+                       ArrayRef<const BasicBlock *> Sources) {
+                     std::string Expr;
+                     raw_string_ostream ExprOS(Expr);
+                     ExprOS << Orig;
+                     StringRef Trimmed = StringRef(ExprOS.str()).trim();
+                     HoistedIn[&Target].push_back(Trimmed.str());
+                     for (const BasicBlock *Source : Sources)
+                       HoistedOut[Source].push_back(Trimmed.str());
+                   });
+
+    std::string Filename =
+        (DotFilenamePrefix + "." + F->getName() + ".dot").str();
+    errs() << "Writing '" << Filename << "'...";
+    std::error_code EC;
+    raw_fd_ostream File(Filename, EC, sys::fs::OF_Text);
+    if (EC) {
+      errs() << "  error opening file for writing!\n";
+      continue;
+    }
+    writeAnticipationGraph(File, *F, BFI, InSets, OutSets, HoistedIn,
+                           HoistedOut);
+    errs() << "\n";
+  }
+  return PreservedAnalyses::all();
+}
+
 } // namespace
 
 //===----------------------------------------------------------------------===//
@@ -236,6 +1750,47 @@ extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
                     FPM.addPass(HoistAnticipatedExpressionsPass());
                     return true;
                   }
+                  if (Name == "hoist-anticipated-expressions<vectorize>") {
+                    FPM.addPass(HoistAnticipatedExpressionsPass(
+                        /*VectorizeFriendly=*/true));
+                    return true;
+                  }
+                  return false;
+                });
+            PB.registerPeepholeEPCallback(
+                [](FunctionPassManager &FPM, OptimizationLevel) {
+                  if (Position == PipelinePosition::Peephole)
+                    FPM.addPass(HoistAnticipatedExpressionsPass());
+                });
+            PB.registerScalarOptimizerLateEPCallback(
+                [](FunctionPassManager &FPM, OptimizationLevel) {
+                  if (Position == PipelinePosition::ScalarOptimizerLate)
+                    FPM.addPass(HoistAnticipatedExpressionsPass());
+                });
+            PB.registerVectorizerStartEPCallback(
+                [](FunctionPassManager &FPM, OptimizationLevel) {
+                  if (Position == PipelinePosition::VectorizerStart)
+                    FPM.addPass(HoistAnticipatedExpressionsPass(
+                        /*VectorizeFriendly=*/true));
+                });
+            PB.registerOptimizerLastEPCallback(
+                [](ModulePassManager &MPM, OptimizationLevel,
+                   ThinOrFullLTOPhase) {
+                  if (Position == PipelinePosition::OptimizerLast)
+                    MPM.addPass(createModuleToFunctionPassAdaptor(
+                        HoistAnticipatedExpressionsPass()));
+                });
+            PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<hoist-anticipated-expressions>") {
+                    MPM.addPass(HoistAnticipatedExpressionsReportPass(errs()));
+                    return true;
+                  }
+                  if (Name == "dot-anticipated-expressions") {
+                    MPM.addPass(DOTAnticipatedExpressionsPass());
+                    return true;
+                  }
                   return false;
                 });
           }};
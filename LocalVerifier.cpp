@@ -0,0 +1,130 @@
+//===----------------------------------------------------------------------===//
+//
+// LocalVerifier - Structural checks of the blocks a transformation touched.
+//
+//===----------------------------------------------------------------------===//
+
+#include "LocalVerifier.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// Starts the description of a problem in block BB.
+static raw_ostream &describe(raw_ostream &OS, const BasicBlock &BB) {
+  OS << "block ";
+  BB.printAsOperand(OS, /*PrintType=*/false);
+  return OS << " in function '" << BB.getParent()->getName() << "': ";
+}
+
+static std::string checkTerminator(const BasicBlock &BB) {
+  std::string Msg;
+  raw_string_ostream OS(Msg);
+  const Instruction *Last = BB.empty() ? nullptr : &BB.back();
+  if (!Last || !Last->isTerminator()) {
+    describe(OS, BB) << "does not end in a terminator";
+    return OS.str();
+  }
+  for (const Instruction &I : BB)
+    if (&I != Last && I.isTerminator()) {
+      describe(OS, BB) << "terminator in the middle of the block:\n  " << I;
+      return OS.str();
+    }
+  return "";
+}
+
+static std::string checkPHIs(const BasicBlock &BB) {
+  std::string Msg;
+  raw_string_ostream OS(Msg);
+  SmallDenseMap<const BasicBlock *, unsigned, 8> Edges;
+  for (const BasicBlock *Pred : predecessors(&BB))
+    ++Edges[Pred];
+
+  bool SeenNonPHI = false;
+  for (const Instruction &I : BB) {
+    auto *PN = dyn_cast<PHINode>(&I);
+    if (!PN) {
+      SeenNonPHI = true;
+      continue;
+    }
+    if (SeenNonPHI) {
+      describe(OS, BB) << "phi after a non-phi instruction:\n  " << *PN;
+      return OS.str();
+    }
+    SmallDenseMap<const BasicBlock *, unsigned, 8> Incoming;
+    SmallDenseMap<const BasicBlock *, const Value *, 8> Values;
+    for (unsigned K = 0, E = PN->getNumIncomingValues(); K != E; ++K) {
+      const BasicBlock *From = PN->getIncomingBlock(K);
+      const Value *V = PN->getIncomingValue(K);
+      ++Incoming[From];
+      auto Inserted = Values.try_emplace(From, V);
+      if (!Inserted.second && Inserted.first->second != V) {
+        describe(OS, BB) << "phi has different values for one predecessor:\n  "
+                         << *PN;
+        return OS.str();
+      }
+    }
+    if (Incoming != Edges) {
+      describe(OS, BB) << "phi does not match the predecessors ("
+                       << PN->getNumIncomingValues() << " incoming values, "
+                       << pred_size(&BB) << " edges):\n  " << *PN;
+      return OS.str();
+    }
+  }
+  return "";
+}
+
+// Checks the operands of every instruction of BB, and every use of one.
+static std::string checkDominance(const Function &F, const DominatorTree &DT,
+                                  const BasicBlock &BB) {
+  std::string Msg;
+  raw_string_ostream OS(Msg);
+  auto Check = [&](const Instruction &Def, const Use &U) {
+    auto *User = cast<Instruction>(U.getUser());
+    if (User->getFunction() != &F || Def.getFunction() != &F) {
+      describe(OS, BB) << "use across functions:\n  " << *User;
+      return false;
+    }
+    if (DT.dominates(&Def, U))
+      return true;
+    describe(OS, BB) << "definition does not dominate its use:\n  " << Def
+                     << "\n  " << *User;
+    return false;
+  };
+
+  for (const Instruction &I : BB) {
+    for (const Use &Op : I.operands())
+      if (auto *Def = dyn_cast<Instruction>(Op.get()))
+        if (!Check(*Def, Op))
+          return OS.str();
+    for (const Use &U : I.uses())
+      if (!Check(I, U))
+        return OS.str();
+  }
+  return "";
+}
+
+std::string verifyTouchedBlocks(const Function &F, const DominatorTree &DT,
+                                ArrayRef<BasicBlock *> Blocks) {
+  SmallPtrSet<const BasicBlock *, 16> Visited;
+  for (const BasicBlock *BB : Blocks) {
+    if (!Visited.insert(BB).second)
+      continue;
+    if (BB->getParent() != &F)
+      return "touched block is not in function '" + F.getName().str() + "'";
+    std::string Problem = checkTerminator(*BB);
+    if (Problem.empty())
+      Problem = checkPHIs(*BB);
+    if (Problem.empty())
+      Problem = checkDominance(F, DT, *BB);
+    if (!Problem.empty())
+      return Problem;
+  }
+  return "";
+}
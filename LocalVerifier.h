@@ -0,0 +1,43 @@
+//===----------------------------------------------------------------------===//
+//
+// LocalVerifier - Checks the blocks a transformation touched instead of the
+// whole function.
+//
+// verifyFunction after every pass costs time linear in the function, which
+// dominates the compile time of -verify-each builds on huge functions where
+// the pass changed a handful of blocks. This checks only those blocks, for
+// the invariants moving and merging instructions can break:
+//
+//   terminators  every block ends in exactly one terminator;
+//   phis         phis come first, and list every predecessor once per edge,
+//                with one value per predecessor and no other blocks;
+//   dominance    every operand of an instruction of a touched block, and
+//                every use of one anywhere in the function, is dominated by
+//                its definition.
+//
+// Anything else about the function is assumed to be as valid as it was
+// before the transformation.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef HOIST_ANTICIPATED_EXPRESSIONS_LOCALVERIFIER_H
+#define HOIST_ANTICIPATED_EXPRESSIONS_LOCALVERIFIER_H
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <string>
+
+namespace llvm {
+class BasicBlock;
+class DominatorTree;
+class Function;
+} // namespace llvm
+
+/// Checks \p Blocks of \p F against \p DT, which must be up to date. Blocks
+/// may be listed more than once. Returns a description of the first problem
+/// found, or an empty string if there is none.
+std::string verifyTouchedBlocks(const llvm::Function &F,
+                                const llvm::DominatorTree &DT,
+                                llvm::ArrayRef<llvm::BasicBlock *> Blocks);
+
+#endif // HOIST_ANTICIPATED_EXPRESSIONS_LOCALVERIFIER_H
@@ -0,0 +1,107 @@
+//===----------------------------------------------------------------------===//
+//
+// PerfCounters - perf_event_open based hardware counters (Linux only).
+//
+//===----------------------------------------------------------------------===//
+
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+using namespace llvm;
+
+#ifdef __linux__
+static int openCounter(uint32_t Type, uint64_t Config) {
+  perf_event_attr Attr;
+  std::memset(&Attr, 0, sizeof(Attr));
+  Attr.size = sizeof(Attr);
+  Attr.type = Type;
+  Attr.config = Config;
+  Attr.exclude_kernel = 1;
+  Attr.exclude_hv = 1;
+  Attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(SYS_perf_event_open, &Attr, /*pid=*/0, /*cpu=*/-1,
+                 /*group_fd=*/-1, PERF_FLAG_FD_CLOEXEC);
+}
+#endif
+
+PerfCounters::PerfCounters() {
+  FDs.fill(-1);
+#ifdef __linux__
+  const std::pair<uint32_t, uint64_t> Events[NumCounters] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  };
+  for (unsigned C = 0; C != NumCounters; ++C) {
+    FDs[C] = openCounter(Events[C].first, Events[C].second);
+    if (FDs[C] < 0 && Error.empty())
+      Error = std::string(getName(Counter(C))) + ": " + std::strerror(errno);
+  }
+#else
+  Error = "perf_event_open is only available on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (int FD : FDs)
+    if (FD >= 0)
+      close(FD);
+#endif
+}
+
+bool PerfCounters::isAvailable() const {
+  for (int FD : FDs)
+    if (FD >= 0)
+      return true;
+  return false;
+}
+
+PerfCounters::Values PerfCounters::read() const {
+  Values Result;
+  Result.fill(0);
+#ifdef __linux__
+  for (unsigned C = 0; C != NumCounters; ++C) {
+    // { value, time_enabled, time_running }
+    uint64_t Buf[3];
+    if (FDs[C] < 0 || ::read(FDs[C], Buf, sizeof(Buf)) != sizeof(Buf))
+      continue;
+    // Scale up counters the kernel had to multiplex with other events.
+    Result[C] = Buf[2] && Buf[2] < Buf[1]
+                    ? uint64_t(double(Buf[0]) * Buf[1] / Buf[2])
+                    : Buf[0];
+  }
+#endif
+  return Result;
+}
+
+StringRef PerfCounters::getName(Counter C) {
+  switch (C) {
+  case Cycles:
+    return "cycles";
+  case Instructions:
+    return "instructions";
+  case L1DMisses:
+    return "l1d-misses";
+  case LLCMisses:
+    return "llc-misses";
+  case BranchMisses:
+    return "branch-misses";
+  case NumCounters:
+    break;
+  }
+  return "unknown";
+}
@@ -0,0 +1,56 @@
+//===----------------------------------------------------------------------===//
+//
+// PerfCounters - A small perf_event_open based collector used to profile the
+// phases of HoistAnticipatedExpressionsPass with hardware counters.
+//
+// Counters that cannot be opened (non-Linux hosts, perf_event_paranoid,
+// virtual machines without a PMU, ...) are reported as unavailable instead of
+// failing the compilation.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef HOIST_ANTICIPATED_EXPRESSIONS_PERFCOUNTERS_H
+#define HOIST_ANTICIPATED_EXPRESSIONS_PERFCOUNTERS_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+class PerfCounters {
+public:
+  enum Counter {
+    Cycles,
+    Instructions,
+    L1DMisses,
+    LLCMisses,
+    BranchMisses,
+    NumCounters
+  };
+  using Values = std::array<uint64_t, NumCounters>;
+
+  PerfCounters();
+  ~PerfCounters();
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  /// Returns true if at least one counter could be opened.
+  bool isAvailable() const;
+  /// Returns true if counter \p C could be opened.
+  bool isAvailable(Counter C) const { return FDs[C] >= 0; }
+  /// The reason the first counter failed to open, if any did.
+  const std::string &getError() const { return Error; }
+
+  /// Reads the current value of every available counter, scaled for
+  /// multiplexing. Unavailable counters read as zero.
+  Values read() const;
+
+  static llvm::StringRef getName(Counter C);
+
+private:
+  std::array<int, NumCounters> FDs;
+  std::string Error;
+};
+
+#endif // HOIST_ANTICIPATED_EXPRESSIONS_PERFCOUNTERS_H
@@ -0,0 +1,226 @@
+#!/usr/bin/env python3
+"""Adversarial worst-case inputs with complexity assertions.
+
+Generates CFG shapes that push hoist-anticipated-expressions towards its
+worst-case behaviour, measures the time spent in the pass for a range of input
+sizes, fits `time = c * size^k` by least squares in log-log space (size being
+the number of instructions of the generated function), and fails
+if the fitted exponent k of any shape exceeds the bound:
+
+  nested-diamonds  a chain of nested if/else diamonds whose arms compute the
+                   same expression chain (one outer restart per hoist level)
+  switch-dups      a switch whose many case values share a few duplicated
+                   targets, all computing the same expressions
+  wide-blocks      two arms with hundreds of similar-looking instructions that
+                   feed the isIdenticalTo scans
+  loop-nest        a deep loop nest with identical work on both arms of a
+                   branch in every level
+  cast-fans        extensions of narrow arithmetic next to as much wide
+                   arithmetic of the same opcode that none of them matches
+
+  bench/adversarial.py --plugin build/HoistAnticipatedExpressions.so \\
+      [--max-exponent 2.5] [--shape NAME] [--emit DIR]
+
+--emit writes the generated inputs instead of measuring them, e.g. to add
+them to a regression corpus.
+"""
+
+import argparse
+import math
+import os
+import statistics
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import common  # noqa: E402
+import compile_time  # noqa: E402
+
+
+def expr_chain(prefix, n, x):
+    """Returns IR for a chain of `n` dependent instructions starting at `x`;
+    the i-th link of every arm is identical, so each link is only anticipated
+    once the previous one has been hoisted."""
+    lines, prev = [], x
+    for i in range(n):
+        op = ("mul", "add", "xor", "shl")[i % 4]
+        rhs = x if op != "shl" else "1"
+        lines.append(f"  %{prefix}.{i} = {op} i32 {prev}, {rhs}")
+        prev = f"%{prefix}.{i}"
+    return lines, prev
+
+
+def nested_diamonds(n):
+    """n nested diamonds; every arm computes the same chain of length n."""
+    out = ["define i32 @f(i32 %x, i32 %c) {", "entry:", "  br label %d0"]
+    for d in range(n):
+        out += [f"d{d}:",
+                f"  %c{d} = icmp ugt i32 %c, {d}",
+                f"  br i1 %c{d}, label %t{d}, label %e{d}",
+                f"t{d}:"]
+        chain, _ = expr_chain(f"t{d}", n, "%x")
+        nxt = f"d{d + 1}" if d + 1 < n else "exit"
+        out += chain + [f"  br label %{nxt}", f"e{d}:"]
+        chain, _ = expr_chain(f"e{d}", n, "%x")
+        out += chain + [f"  br label %{nxt}"]
+    out += ["exit:", "  ret i32 0", "}"]
+    return "\n".join(out) + "\n"
+
+
+def switch_dups(n):
+    """A switch with 4n case values spread over n targets, each computing
+    the same 8-instruction chain."""
+    out = ["define i32 @f(i32 %x, i32 %s) {", "entry:",
+           "  switch i32 %s, label %default ["]
+    out += [f"    i32 {v}, label %case{v % n}" for v in range(4 * n)]
+    out += ["  ]"]
+    rets = []
+    for t in range(n):
+        chain, last = expr_chain(f"c{t}", 8, "%x")
+        out += [f"case{t}:"] + chain + ["  br label %exit"]
+        rets.append(f"[ {last}, %case{t} ]")
+    chain, last = expr_chain("def", 8, "%x")
+    out += ["default:"] + chain + ["  br label %exit"]
+    rets.append(f"[ {last}, %default ]")
+    out += ["exit:", f"  %r = phi i32 {', '.join(rets)}", "  ret i32 %r", "}"]
+    return "\n".join(out) + "\n"
+
+
+def wide_blocks(n):
+    """Two arms with n independent instructions each; only every other one
+    is identical across the arms, the rest differ in a constant."""
+    out = ["define i32 @f(i32 %x, i1 %c) {", "entry:",
+           "  br i1 %c, label %then, label %else"]
+    for arm, salt in (("then", 0), ("else", 1)):
+        out.append(f"{arm}:")
+        for i in range(n):
+            k = i if i % 2 == 0 else i + salt * 1000
+            out.append(f"  %{arm}.{i} = add i32 %x, {k}")
+        out.append("  br label %exit")
+    out += ["exit:", "  ret i32 0", "}"]
+    return "\n".join(out) + "\n"
+
+
+def loop_nest(n):
+    """n nested loops; every level branches to two arms doing the same work
+    before entering the next level."""
+    out = ["define i32 @f(i32 %x, i32 %m) {", "entry:", "  br label %h0"]
+    for d in range(n):
+        pre = "entry" if d == 0 else f"j{d - 1}"
+        inner = f"h{d + 1}" if d + 1 < n else f"n{d}"
+        chain_t, _ = expr_chain(f"lt{d}", 4, "%x")
+        chain_e, _ = expr_chain(f"le{d}", 4, "%x")
+        out += [f"h{d}:",
+                f"  %i{d} = phi i32 [ 0, %{pre} ], [ %i{d}.next, %n{d} ]",
+                f"  %c{d} = icmp slt i32 %i{d}, %m",
+                f"  br i1 %c{d}, label %b{d}, label %x{d}",
+                f"b{d}:",
+                f"  %p{d} = and i32 %i{d}, 1",
+                f"  %q{d} = icmp eq i32 %p{d}, 0",
+                f"  br i1 %q{d}, label %lt{d}, label %le{d}",
+                f"lt{d}:"] + chain_t + [f"  br label %j{d}", f"le{d}:"] + \
+            chain_e + [f"  br label %j{d}",
+                       f"j{d}:",
+                       f"  br label %{inner}",
+                       f"n{d}:",
+                       f"  %i{d}.next = add i32 %i{d}, 1",
+                       f"  br label %h{d}",
+                       f"x{d}:"]
+        out += ["  ret i32 0"] if d == 0 else [f"  br label %n{d - 1}"]
+    out += ["}"]
+    return "\n".join(out) + "\n"
+
+
+def cast_fans(n):
+    """n zexts of narrow adds that cannot wrap and n wide adds of another
+    value; every zext is a widening candidate for every wide add."""
+    out = ["define void @f(i16 %a, i64 %y) {", "entry:",
+           "  %x = zext i16 %a to i32"]
+    for i in range(n):
+        out += [f"  %n{i} = add nuw i32 %x, {i}",
+                f"  %e{i} = zext i32 %n{i} to i64",
+                f"  call void @use(i64 %e{i})",
+                f"  %w{i} = add i64 %y, {i}",
+                f"  call void @use(i64 %w{i})"]
+    out += ["  ret void", "}", "declare void @use(i64)"]
+    return "\n".join(out) + "\n"
+
+
+# Generator and generator parameters; the parameters start large enough for
+# the measured time not to be dominated by fixed per-run overhead.
+SHAPES = {
+    "nested-diamonds": (nested_diamonds, [12, 16, 20, 24, 32]),
+    "switch-dups": (switch_dups, [64, 96, 128, 192, 256]),
+    "wide-blocks": (wide_blocks, [256, 384, 512, 768, 1024]),
+    "loop-nest": (loop_nest, [16, 24, 32, 48, 64]),
+    "cast-fans": (cast_fans, [256, 384, 512, 768, 1024]),
+}
+
+
+def instruction_count(ir):
+    """The input size used for fitting: the number of instructions."""
+    return sum(1 for line in ir.splitlines()
+               if line.startswith("  ") and not line.startswith("    "))
+
+
+def fit_exponent(sizes, times):
+    """Least-squares slope of log(time) over log(size)."""
+    xs = [math.log(s) for s in sizes]
+    ys = [math.log(max(t, 1)) for t in times]
+    mx, my = statistics.mean(xs), statistics.mean(ys)
+    return sum((x - mx) * (y - my) for x, y in zip(xs, ys)) / \
+        sum((x - mx) ** 2 for x in xs)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    common.add_common_args(parser)
+    parser.add_argument("--max-exponent", type=float, default=2.5,
+                        help="fail if a fitted exponent exceeds this bound")
+    parser.add_argument("--runs", type=int, default=3,
+                        help="runs per size; the median time is fitted")
+    parser.add_argument("--shape", action="append", choices=sorted(SHAPES),
+                        help="only run these shapes (default: all)")
+    parser.add_argument("--emit", metavar="DIR",
+                        help="write the generated inputs to DIR and exit")
+    args = parser.parse_args()
+    args.perf_counters = False
+
+    shapes = args.shape or list(SHAPES)
+    if args.emit:
+        os.makedirs(args.emit, exist_ok=True)
+        for shape in shapes:
+            gen, params = SHAPES[shape]
+            for param in params:
+                with open(os.path.join(args.emit, f"{shape}-{param}.ll"),
+                          "w") as f:
+                    f.write(gen(param))
+        return 0
+
+    failed = False
+    with tempfile.TemporaryDirectory() as workdir:
+        trace = os.path.join(workdir, "trace.json")
+        path = os.path.join(workdir, "input.ll")
+        for shape in shapes:
+            gen, params = SHAPES[shape]
+            sizes, times = [], []
+            for param in params:
+                ir = gen(param)
+                sizes.append(instruction_count(ir))
+                with open(path, "w") as f:
+                    f.write(ir)
+                times.append(statistics.median(
+                    compile_time.measure(args, path, trace)[0]["total"]
+                    for _ in range(args.runs)))
+            k = fit_exponent(sizes, times)
+            verdict = "ok" if k <= args.max_exponent else "FAIL"
+            failed |= verdict == "FAIL"
+            print(f"{shape:16} exponent {k:5.2f} (bound {args.max_exponent})"
+                  f"  {verdict}")
+            for size, t in zip(sizes, times):
+                print(f"  size {size:5}  {t:>12.0f} us")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
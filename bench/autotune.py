@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+"""Offline autotuner for the placement and the options of the pass.
+
+Searches over where the pass runs in a scalar optimization pipeline and over
+its options, and reports the configurations that are Pareto-optimal in
+runtime and compile time on a corpus.
+
+The pipeline is --base, a comma-separated list of function passes (by default
+instcombine, simplifycfg, gvn and licm, after sroa brought the corpus to SSA).
+The pass is placed in one of the slots between them, `start` (first) or
+`after-<pass>`, or left out (`none`). Its options are the budgets and the
+switches of its matching and cleanup steps, and vectorization-friendly mode.
+Every configuration is measured on the whole corpus:
+
+  runtime       every scalar-signature function runs through `lli` on
+                --inputs generated inputs, --repeat calls each, as in
+                bench/diff_exec.py; the median over --runs of the total time;
+  compile time  the wall-clock time of `opt` on the corpus with the pipeline,
+                the median over --runs.
+
+Every function must return the same results as with `none`; configurations
+where one does not are reported and left out of the Pareto set. The search
+measures `none`, the pass with its default options in every slot, and then
+random configurations (--seed) until --trials have been measured.
+
+  bench/autotune.py --plugin build/HoistAnticipatedExpressions.so \\
+      [--trials 24] [--runs 3] [--base 'instcombine,gvn'] \\
+      [--json autotune.json] [corpus...]
+
+The Pareto-optimal configurations are printed last, fastest code first, as
+`-passes=` pipeline strings followed by the options they set.
+"""
+
+import argparse
+import json
+import os
+import random
+import statistics
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import common  # noqa: E402
+import diff_exec  # noqa: E402
+
+# Options of the pass and the values tried, the default first.
+OPTIONS = {
+    "hoist-anticipated-max-hoists": ("0", "4", "16"),
+    "hoist-anticipated-max-hoists-per-block": ("0", "2", "8"),
+    "hoist-anticipated-scev-equivalence": ("true", "false"),
+    "hoist-anticipated-widen-casts": ("true", "false"),
+    "hoist-anticipated-select-arms": ("true", "false"),
+    "hoist-anticipated-fold-branches": ("true", "false"),
+}
+
+
+def split_passes(pipeline):
+    """Splits a pass list at the commas outside parentheses."""
+    passes, depth, start = [], 0, 0
+    for k, ch in enumerate(pipeline):
+        depth += {"(": 1, "<": 1, ")": -1, ">": -1}.get(ch, 0)
+        if ch == "," and depth == 0:
+            passes.append(pipeline[start:k].strip())
+            start = k + 1
+    passes.append(pipeline[start:].strip())
+    return [p for p in passes if p]
+
+
+def slot_names(base):
+    """Returns the slots of the pass in `base`: `start` and after-<pass>."""
+    names = ["start"]
+    for p in base:
+        name = "after-" + p.split("(")[-1].split("<")[0].rstrip(")")
+        # A pass listed twice gets after-<pass>.2 for its second slot.
+        count = sum(1 for n in names if n.split(".")[0] == name)
+        names.append(f"{name}.{count + 1}" if count else name)
+    return names
+
+
+class Config:
+    """A slot (or `none`) and the options of the pass that differ from their
+    defaults."""
+
+    def __init__(self, slot, vectorize=False, options=None):
+        self.slot = slot
+        self.vectorize = vectorize
+        self.options = {k: v for k, v in (options or {}).items()
+                        if v != OPTIONS[k][0]}
+
+    def key(self):
+        return (self.slot, self.vectorize, tuple(sorted(self.options.items())))
+
+    def pipeline(self, prepare, base, slots):
+        passes = list(base)
+        if self.slot != "none":
+            name = common.PASS_NAME + ("<vectorize>" if self.vectorize else "")
+            passes.insert(slots.index(self.slot), name)
+        return f"{prepare},function({','.join(passes)})"
+
+    def flags(self):
+        return [f"-{k}={v}" for k, v in sorted(self.options.items())]
+
+    def describe(self):
+        if self.slot == "none":
+            return "none"
+        words = [self.slot] + (["vectorize"] if self.vectorize else [])
+        words += [f"{k[len('hoist-anticipated-'):]}={v}"
+                  for k, v in sorted(self.options.items())]
+        return " ".join(words)
+
+
+def random_config(rng, slots):
+    return Config(rng.choice(slots), rng.random() < 0.5,
+                  {k: rng.choice(v) for k, v in OPTIONS.items()})
+
+
+def optimize(args, config, files, workdir):
+    """Runs the pipeline of `config` on every file. Returns ([optimized
+    files], median wall-clock seconds of all opt runs together)."""
+    pipeline = config.pipeline(args.prepare, args.base_passes, args.slots)
+    outputs = [os.path.join(workdir, f"{k}.ll") for k in range(len(files))]
+    samples = []
+    for _ in range(args.runs):
+        start = time.perf_counter()
+        for path, out in zip(files, outputs):
+            common.run(common.opt_cmd(args, pipeline=pipeline,
+                                      extra=config.flags() +
+                                      ["-S", path, "-o", out]))
+        samples.append(time.perf_counter() - start)
+    return outputs, statistics.median(samples)
+
+
+def measure(args, config, functions, workdir):
+    """Returns the record of `config`: compile and run times and the results
+    of every function on its inputs."""
+    files = sorted({f["file"] for f in functions})
+    outputs, compile_s = optimize(args, config, files, workdir)
+    module = dict(zip(files, outputs))
+    results, runtime = {}, [0] * args.runs
+    for f in functions:
+        for run in range(args.runs):
+            values, ns, crashed = diff_exec.execute(
+                args, module[f["file"]], f["name"], f["ret"], f["params"],
+                f["inputs"], workdir)
+            if crashed or ns is None:
+                return {"config": config.describe(), "status": "CRASH",
+                        "function": f["label"]}
+            runtime[run] += ns
+        results[f["label"]] = values
+    return {"config": config.describe(), "status": "OK",
+            "compile_ms": compile_s * 1e3,
+            "runtime_ns": statistics.median(runtime),
+            "pipeline": config.pipeline(args.prepare, args.base_passes,
+                                        args.slots),
+            "flags": config.flags(), "results": results}
+
+
+def collect_functions(args, files, rng, workdir):
+    """Returns the functions to time with their inputs; inputs on which the
+    function traps or hangs before any optimization are dropped."""
+    functions = []
+    for path in files:
+        with open(path) as f:
+            ir = f.read()
+        prepared = os.path.join(workdir, "prepared.ll")
+        common.run([common.tool(args, "opt"), f"-passes={args.prepare}", "-S",
+                    path, "-o", prepared])
+        for name, ret, params, linkage in common.scalar_functions(ir):
+            if {"internal", "private"} & set(linkage):
+                continue
+            inputs = [[diff_exec.literal(t, rng) for t in params]
+                      for _ in range(args.inputs)]
+            while inputs:
+                done, _, crashed = diff_exec.execute(args, prepared, name, ret,
+                                                     params, inputs, workdir)
+                if not crashed:
+                    break
+                del inputs[len(done)]
+            if inputs:
+                functions.append({"file": path, "name": name, "ret": ret,
+                                  "params": params, "inputs": inputs,
+                                  "label": f"{os.path.basename(path)}:{name}"})
+    return functions
+
+
+def pareto(records):
+    """Returns the records no other record beats in both objectives, fastest
+    code first."""
+    front = []
+    for r in records:
+        dominated = any(
+            o["runtime_ns"] <= r["runtime_ns"] and
+            o["compile_ms"] <= r["compile_ms"] and
+            (o["runtime_ns"], o["compile_ms"]) !=
+            (r["runtime_ns"], r["compile_ms"])
+            for o in records)
+        if not dominated:
+            front.append(r)
+    return sorted(front, key=lambda r: (r["runtime_ns"], r["compile_ms"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    common.add_common_args(parser)
+    parser.add_argument("--prepare", default="function(sroa)",
+                        help="passes run before the tuned pipeline")
+    parser.add_argument("--base",
+                        default="instcombine,simplifycfg,gvn,loop-mssa(licm)",
+                        help="function passes the pass is placed among")
+    parser.add_argument("--trials", type=int, default=24,
+                        help="configurations to measure, at least none and "
+                             "every slot with the default options")
+    parser.add_argument("--inputs", type=int, default=8,
+                        help="generated inputs per function")
+    parser.add_argument("--repeat", type=int, default=1000,
+                        help="calls per input inside the timed loop")
+    parser.add_argument("--runs", type=int, default=3,
+                        help="measurements per configuration; the median is "
+                             "kept")
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--timeout", type=float, default=60.0,
+                        help="seconds allowed per lli run")
+    parser.add_argument("--json", help="write all measurements to this file")
+    parser.add_argument("corpus", nargs="*",
+                        help=".ll files or directories (default: bench/corpus)")
+    args = parser.parse_args()
+    args.base_passes = split_passes(args.base)
+    args.slots = slot_names(args.base_passes)
+
+    rng = random.Random(args.seed)
+    configs = [Config("none")] + [Config(s) for s in args.slots]
+    seen = {c.key() for c in configs}
+    # The space is finite; stop drawing once nearly every draw is a repeat.
+    for _ in range(100 * args.trials):
+        if len(configs) >= args.trials:
+            break
+        c = random_config(rng, args.slots)
+        if c.key() not in seen:
+            seen.add(c.key())
+            configs.append(c)
+
+    records = []
+    with tempfile.TemporaryDirectory() as workdir:
+        functions = collect_functions(args, common.corpus_files(args.corpus),
+                                      rng, workdir)
+        if not functions:
+            sys.exit("error: no function of the corpus can be run")
+        print(f"{'status':8} {'runtime':>12} {'compile':>10}  configuration")
+        for config in configs:
+            rec = measure(args, config, functions, workdir)
+            if rec["status"] == "OK" and records and \
+                    rec["results"] != records[0]["results"]:
+                rec["status"] = "MISMATCH"
+                rec["function"] = next(
+                    f for f, v in rec["results"].items()
+                    if v != records[0]["results"][f])
+            records.append(rec)
+            if rec["status"] == "OK":
+                print(f"{'OK':8} {rec['runtime_ns'] / 1e3:10.1f}us "
+                      f"{rec['compile_ms']:8.1f}ms  {rec['config']}")
+            else:
+                print(f"{rec['status']:8} {'':>12} {'':>10}  {rec['config']} "
+                      f"(in {rec['function']})")
+            if records[0]["status"] != "OK":
+                sys.exit("error: the pipeline without the pass does not run")
+
+    front = pareto([r for r in records if r["status"] == "OK"])
+    base = records[0]
+    print("\nPareto-optimal configurations (runtime, compile time relative "
+          "to none):")
+    for r in front:
+        runtime = 100.0 * (r["runtime_ns"] - base["runtime_ns"]) / \
+            base["runtime_ns"]
+        compile_ms = 100.0 * (r["compile_ms"] - base["compile_ms"]) / \
+            base["compile_ms"]
+        print(f"  {runtime:+6.1f}% {compile_ms:+6.1f}%  "
+              f"-passes='{r['pipeline']}'" +
+              "".join(" " + f for f in r["flags"]))
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"functions": [f["label"] for f in functions],
+                       "configurations": records,
+                       "pareto": [r["config"] for r in front]}, f, indent=2)
+    return 1 if any(r["status"] != "OK" for r in records) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
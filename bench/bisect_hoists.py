@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""Finds the single hoist or rewrite responsible for a regression.
+
+Every change hoist-anticipated-expressions makes to the IR, a hoist or a
+rewrite of its cast, select and branch steps, is counted by the debug counter
+`hoist-anticipated-expressions-hoist` and is an -opt-bisect-limit point of its
+own. This script lists the changes made to an input, then enables only the
+first k of them (-debug-counter=hoist-anticipated-expressions-hoist=0-K) and
+bisects k with a user supplied test:
+
+  bench/bisect_hoists.py --plugin build/HoistAnticipatedExpressions.so \\
+      --test 'check.sh {}' input.ll
+
+`{}` in the test command is replaced by the path of the optimized module. The
+test must exit 0 when the module is fine (e.g. a benchmark is within its
+budget) and non-zero when it shows the regression. It is assumed to pass
+without any change and is checked to fail with all of them. Debug counters
+are ignored by NDEBUG builds of some LLVM versions, so the pass is first run
+alone with the counter disabling every change, and must leave the input
+unchanged. With --one-by-one every change is disabled on its own instead,
+which also finds culprits whose effect depends on later ones.
+"""
+
+import argparse
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import common  # noqa: E402
+
+COUNTER = "hoist-anticipated-expressions-hoist"
+_CHANGE = re.compile(r"^BISECT: running pass \(\d+\) "
+                     r"HoistAnticipatedExpressionsPass (\w+) on (.*)$")
+
+
+def llvm_major(args):
+    out = common.run([common.tool(args, "opt"), "--version"]).stdout
+    m = re.search(r"LLVM version (\d+)", out)
+    return int(m.group(1)) if m else 0
+
+
+def list_changes(args):
+    """Returns the descriptions of all changes, in counter order. The bisect
+    limit is high enough to run everything; INT_MAX itself disables it."""
+    proc = common.run(common.opt_cmd(args, pipeline=args.passes, extra=[
+        "-disable-output", "-opt-bisect-limit=2147483646", args.input]))
+    return [f"{m.group(1)} {m.group(2)}"
+            for m in map(_CHANGE.match, proc.stderr.splitlines()) if m]
+
+
+def counter_option(args, enabled):
+    """-debug-counter value enabling exactly the changes in the sorted list
+    `enabled`, in the chunk syntax of LLVM 19 and later or the skip/count
+    syntax before."""
+    if not enabled:
+        # A change number that is never reached.
+        enabled = [2 ** 31 - 1]
+    if not args.legacy_counters:
+        chunks, start = [], None
+        for i, n in enumerate(enabled):
+            if start is None:
+                start = n
+            if i + 1 == len(enabled) or enabled[i + 1] != n + 1:
+                chunks.append(str(start) if start == n else f"{start}-{n}")
+                start = None
+        return f"-debug-counter={COUNTER}=" + ":".join(chunks)
+    if enabled == [2 ** 31 - 1]:
+        return f"-debug-counter={COUNTER}-skip={enabled[0]}"
+    if enabled != list(range(len(enabled))):
+        sys.exit("error: --one-by-one needs LLVM 19 or later")
+    return (f"-debug-counter={COUNTER}-skip=0,"
+            f"{COUNTER}-count={len(enabled)}")
+
+
+def counter_honored(args, workdir):
+    """Returns True if the pass, with every change disabled through the
+    counter, leaves the input as it is."""
+    unchanged = os.path.join(workdir, "input.ll")
+    common.run([common.tool(args, "opt"), "-S", args.input, "-o", unchanged])
+    out = os.path.join(workdir, "no-changes.ll")
+    common.run(common.opt_cmd(args, extra=[
+        counter_option(args, []), "-S", args.input, "-o", out]))
+    with open(unchanged) as a, open(out) as b:
+        return a.read() == b.read()
+
+
+def passes(args, enabled, workdir):
+    """Runs the test on the input optimized with only `enabled` changes;
+    returns True if it passes."""
+    out = os.path.join(workdir, "bisect.ll")
+    common.run(common.opt_cmd(args, pipeline=args.passes, extra=[
+        counter_option(args, enabled), "-S", args.input, "-o", out]))
+    cmd = args.test.replace("{}", shlex.quote(out))
+    return subprocess.run(cmd, shell=True).returncode == 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    common.add_common_args(parser)
+    parser.add_argument("--test", required=True,
+                        help="shell command; {} is the optimized module")
+    parser.add_argument("--passes", default=common.PASS_NAME,
+                        help="pipeline to run (default: the pass alone)")
+    parser.add_argument("--one-by-one", action="store_true",
+                        help="disable each change on its own")
+    parser.add_argument("input", help="module to optimize")
+    args = parser.parse_args()
+    args.legacy_counters = llvm_major(args) < 19
+
+    changes = list_changes(args)
+    n = len(changes)
+    print(f"{n} change(s)")
+    if not n:
+        return 1
+
+    with tempfile.TemporaryDirectory() as workdir:
+        if not counter_honored(args, workdir):
+            sys.exit(f"error: {COUNTER} counter not honored (NDEBUG build?)")
+        if args.one_by_one:
+            culprits = [i for i in range(n)
+                        if passes(args, [j for j in range(n) if j != i],
+                                  workdir)]
+            for i in culprits:
+                print(f"disabling change {i} fixes it: {changes[i]}")
+            if not culprits:
+                print("no single change is responsible")
+            return 0 if culprits else 1
+
+        if passes(args, list(range(n)), workdir):
+            print("the test passes with all changes; nothing to bisect")
+            return 1
+        # Invariant: the first `good` changes pass, the first `bad` fail.
+        good, bad = 0, n
+        while bad - good > 1:
+            mid = (good + bad) // 2
+            if passes(args, list(range(mid)), workdir):
+                good = mid
+            else:
+                bad = mid
+            print(f"  first {mid} change(s): "
+                  f"{'pass' if good == mid else 'fail'}")
+    culprit = bad - 1
+    print(f"first failing change {culprit} "
+          f"(-debug-counter={COUNTER}=0-{culprit}): {changes[culprit]}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
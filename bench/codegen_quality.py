@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""Codegen-quality benchmark for hoist-anticipated-expressions.
+
+Compiles every corpus file with `llc` for each target, once as written and
+once after the pass, and compares per function:
+
+  size      bytes of the function in .text (llvm-nm --print-size of the
+            object, built with -function-sections)
+  insts     machine instructions emitted (asm-printer remarks)
+  spills    spills and folded spills inserted by the register allocator
+  reloads   reloads and folded reloads
+  copies    virtual register copies
+  cost      block-frequency weighted cost of all of the above
+
+The register allocator numbers come from the function-level
+SpillReloadCopies remarks of `-pass-remarks-output`, so they do not require an
+LLVM build with statistics enabled.
+
+  bench/codegen_quality.py --plugin build/HoistAnticipatedExpressions.so \\
+      [--target x86_64-unknown-linux-gnu] [--mcpu NAME] [--json cg.json] \\
+      [corpus...]
+
+Without --target both x86-64 and AArch64 are measured. A positive delta means
+the transformed code is larger or spills more, i.e. the hoists increased
+register pressure.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import common  # noqa: E402
+
+DEFAULT_TARGETS = ("x86_64-unknown-linux-gnu", "aarch64-unknown-linux-gnu")
+METRICS = ("size", "insts", "spills", "reloads", "copies", "cost")
+
+# Remark argument -> metric it is added to.
+REGALLOC_ARGS = {
+    "NumSpills": "spills",
+    "NumFoldedSpills": "spills",
+    "NumReloads": "reloads",
+    "NumFoldedReloads": "reloads",
+    "NumZeroCostFoldedReloads": "reloads",
+    "NumVRCopies": "copies",
+    "TotalSpillsCost": "cost",
+    "TotalFoldedSpillsCost": "cost",
+    "TotalReloadsCost": "cost",
+    "TotalFoldedReloadsCost": "cost",
+    "TotalCopiesCost": "cost",
+}
+_ARG = re.compile(r"^\s*- (\w+):\s*'?(.*?)'?$")
+
+
+def parse_remarks(text):
+    """Returns {function: {metric: value}} from a remarks YAML file. Only the
+    function-level regalloc summaries are used; the per-loop ones would count
+    the same spills twice."""
+    stats = {}
+    for doc in re.split(r"^--- ", text, flags=re.M):
+        fields, args = {}, []
+        for line in doc.splitlines():
+            m = _ARG.match(line)
+            if m:
+                args.append((m.group(1), m.group(2)))
+            elif ":" in line and not line.startswith(" "):
+                key, _, value = line.partition(":")
+                fields[key.strip()] = value.strip()
+        func = fields.get("Function")
+        if not func:
+            continue
+        entry = stats.setdefault(func, dict.fromkeys(METRICS[1:], 0))
+        name = fields.get("Name")
+        if name == "InstructionCount":
+            entry["insts"] = int(dict(args)["NumInstructions"])
+        elif name == "SpillReloadCopies" and \
+                any(k == "String" and "in function" in v for k, v in args):
+            for key, value in args:
+                if key in REGALLOC_ARGS:
+                    entry[REGALLOC_ARGS[key]] += float(value)
+    return stats
+
+
+def function_sizes(args, obj):
+    """Returns {function: bytes} for the functions defined in `obj`."""
+    out = common.run([common.tool(args, "llvm-nm"), "--print-size",
+                      "--defined-only", obj]).stdout
+    sizes = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in "Tt":
+            sizes[fields[3]] = int(fields[1], 16)
+    return sizes
+
+
+def compile_stats(args, module, target, workdir):
+    """Runs llc on `module`; returns {function: {metric: value}}."""
+    obj = os.path.join(workdir, "out.o")
+    remarks = os.path.join(workdir, "remarks.yaml")
+    cmd = [common.tool(args, "llc"), f"-O{args.opt_level}",
+           f"-mtriple={target}", "-filetype=obj", "-function-sections",
+           f"-pass-remarks-output={remarks}",
+           "-pass-remarks-filter=regalloc|asm-printer", module, "-o", obj]
+    if args.mcpu:
+        cmd.append(f"-mcpu={args.mcpu}")
+    common.run(cmd)
+    with open(remarks) as f:
+        stats = parse_remarks(f.read())
+    for func, size in function_sizes(args, obj).items():
+        stats.setdefault(func, dict.fromkeys(METRICS[1:], 0))["size"] = size
+    return stats
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    common.add_common_args(parser)
+    parser.add_argument("--target", action="append",
+                        help="target triple (default: x86-64 and AArch64)")
+    parser.add_argument("--mcpu", help="CPU passed to llc")
+    parser.add_argument("--opt-level", default="2", choices="0123",
+                        help="llc optimization level (default: 2)")
+    parser.add_argument("--json", help="write the results to this file")
+    parser.add_argument("corpus", nargs="*",
+                        help=".ll files or directories (default: bench/corpus)")
+    args = parser.parse_args()
+
+    records = []
+    totals = {}
+    print(f"{'function':32} {'target':8}" +
+          "".join(f"{m:>16}" for m in METRICS))
+    for path in common.corpus_files(args.corpus):
+        with tempfile.TemporaryDirectory() as workdir:
+            new = os.path.join(workdir, "new.ll")
+            common.run(common.opt_cmd(args, extra=["-S", path, "-o", new]))
+            for target in args.target or DEFAULT_TARGETS:
+                base_stats = compile_stats(args, path, target, workdir)
+                new_stats = compile_stats(args, new, target, workdir)
+                arch = target.split("-")[0]
+                for func in sorted(base_stats):
+                    before = base_stats[func]
+                    after = new_stats.get(func, before)
+                    before.setdefault("size", 0)
+                    after.setdefault("size", 0)
+                    records.append({"file": path, "function": func,
+                                    "target": target, "before": before,
+                                    "after": after})
+                    total = totals.setdefault(
+                        arch, {m: [0, 0] for m in METRICS})
+                    row = f"{os.path.basename(path) + ':' + func:32} {arch:8}"
+                    for m in METRICS:
+                        total[m][0] += before[m]
+                        total[m][1] += after[m]
+                        row += f"{before[m]:>7.0f} {after[m] - before[m]:>+7.0f} "
+                    print(row)
+
+    print("\ntotals (before, change)")
+    for arch, total in totals.items():
+        row = f"{'':32} {arch:8}"
+        for m in METRICS:
+            before, after = total[m]
+            change = (after - before) / before if before else 0.0
+            row += f"{before:>7.0f} {change:>+7.1%} "
+        print(row)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(records, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,91 @@
+"""Helpers shared by the benchmark and validation scripts in this directory.
+
+The scripts drive the out-of-tree plugin through the regular LLVM tools, so
+they only need `opt`, `lli`, `llc`, ... on PATH (or in --llvm-bin) and a built
+HoistAnticipatedExpressions plugin.
+"""
+
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+PASS_NAME = "hoist-anticipated-expressions"
+REPO_ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CORPUS_DIR = os.path.join(REPO_ROOT, "bench", "corpus")
+
+
+def add_common_args(parser):
+    parser.add_argument("--llvm-bin", default=os.environ.get("LLVM_BIN"),
+                        help="directory containing opt/lli/llc (default: PATH)")
+    parser.add_argument("--plugin", default=os.environ.get("HAE_PLUGIN"),
+                        help="path to the built pass plugin "
+                             "(default: look in ./build)")
+
+
+def tool(args, name):
+    """Returns the path of LLVM tool `name`, honouring --llvm-bin."""
+    if args.llvm_bin:
+        return os.path.join(args.llvm_bin, name)
+    path = shutil.which(name)
+    if not path:
+        sys.exit(f"error: '{name}' not found on PATH; use --llvm-bin")
+    return path
+
+
+def plugin(args):
+    """Returns the path of the pass plugin, honouring --plugin."""
+    if args.plugin:
+        return args.plugin
+    for name in ("HoistAnticipatedExpressions.so",
+                 "libHoistAnticipatedExpressions.so"):
+        path = os.path.join(REPO_ROOT, "build", name)
+        if os.path.exists(path):
+            return path
+    sys.exit("error: pass plugin not found in ./build; use --plugin")
+
+
+def corpus_files(paths):
+    """Expands files and directories into a sorted list of .ll files."""
+    files = []
+    for path in paths or [CORPUS_DIR]:
+        if os.path.isdir(path):
+            files += [os.path.join(path, f) for f in sorted(os.listdir(path))
+                      if f.endswith(".ll")]
+        else:
+            files.append(path)
+    return files
+
+
+def run(cmd, timeout=None, check=True):
+    """Runs `cmd`, returning the CompletedProcess with decoded output."""
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                          universal_newlines=True, timeout=timeout)
+    if check and proc.returncode != 0:
+        sys.exit(f"error: {' '.join(cmd)} failed:\n{proc.stderr}")
+    return proc
+
+
+def opt_cmd(args, pipeline=PASS_NAME, extra=()):
+    """Returns an `opt` command line with the plugin loaded."""
+    return [tool(args, "opt"), "-load-pass-plugin", plugin(args),
+            f"-passes={pipeline}", *extra]
+
+
+_DEFINE = re.compile(r"^define\s+(.*?)@(\"[^\"]+\"|[\w.$-]+)\((.*?)\)", re.M)
+SCALAR_TYPE = re.compile(r"^(void|i\d+|half|float|double)$")
+
+
+def scalar_functions(ir):
+    """Yields (name, return type, [param types], linkage words) for every
+    function definition whose signature only uses scalar types."""
+    for m in _DEFINE.finditer(ir):
+        prefix, name, params = m.group(1).split(), m.group(2), m.group(3)
+        if not prefix or not SCALAR_TYPE.match(prefix[-1]):
+            continue
+        types = []
+        for param in filter(None, (p.strip() for p in params.split(","))):
+            types.append(param.split()[0])
+        if all(SCALAR_TYPE.match(t) and t != "void" for t in types):
+            yield name, prefix[-1], types, prefix[:-1]
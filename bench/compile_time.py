@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Compile-time benchmark for hoist-anticipated-expressions.
+
+Runs the pass over every corpus file `--runs` times and measures the time
+spent inside the pass from its -time-trace events, which excludes IR parsing
+and process start-up. Times are reported per phase (UseDef, Dataflow, Hoist)
+and in total, in microseconds.
+
+With --perf-counters the pass also reads hardware performance counters
+(cycles, instructions, L1D/LLC misses, branch misses) around each phase via
+perf_event_open, which tells whether a phase is bound by cache misses or by
+branch mispredictions. Counters the host does not provide are reported as
+unavailable and the timing results are still produced.
+
+  bench/compile_time.py --plugin build/HoistAnticipatedExpressions.so \\
+      [--runs 5] [--perf-counters] [--json compile.json] [corpus...]
+
+The JSON output maps each corpus file to the samples of every measurement and
+is accepted by `bench/history.py record --compile`.
+"""
+
+import argparse
+import json
+import os
+import statistics
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import common  # noqa: E402
+
+EVENT = "HoistAnticipatedExpressions"
+PHASES = ("UseDef", "Dataflow", "Hoist")
+COUNTERS = ("cycles", "instructions", "l1d-misses", "llc-misses",
+            "branch-misses")
+PERF_PREFIX = "hoist-anticipated-expressions perf: "
+
+
+def parse_counters(stderr):
+    """Sums the per-function counter lines of the pass per phase. Returns
+    ({phase: {counter: value or None}}, reason if unavailable)."""
+    totals = {p: dict.fromkeys(COUNTERS, 0) for p in PHASES}
+    for line in stderr.splitlines():
+        if not line.startswith(PERF_PREFIX):
+            continue
+        fields = line[len(PERF_PREFIX):].split()
+        if not fields:
+            continue
+        if fields[0] == "hardware":
+            return None, line[len(PERF_PREFIX):]
+        phase = fields[1]
+        for field in fields[2:]:
+            counter, value = field.split("=")
+            if value == "n/a":
+                totals[phase][counter] = None
+            elif totals[phase][counter] is not None:
+                totals[phase][counter] += int(value)
+    return totals, None
+
+
+def measure(args, path, trace):
+    """Runs the pass once on `path`; returns ({measurement: microseconds},
+    per-phase counters or None, reason the counters are unavailable)."""
+    extra = ["-disable-output", "-time-trace", "-time-trace-granularity=0",
+             f"-time-trace-file={trace}", path]
+    if args.perf_counters:
+        extra.append("-hoist-anticipated-perf-counters")
+    proc = common.run(common.opt_cmd(args, extra=extra))
+    with open(trace) as f:
+        events = json.load(f)["traceEvents"]
+    times = dict.fromkeys(("total",) + PHASES, 0)
+    for e in events:
+        if e.get("ph") != "X":
+            continue
+        if e["name"] == EVENT:
+            times["total"] += e["dur"]
+        elif e["name"].startswith(EVENT + "."):
+            phase = e["name"][len(EVENT) + 1:]
+            if phase in times:
+                times[phase] += e["dur"]
+    if not args.perf_counters:
+        return times, None, None
+    counters, reason = parse_counters(proc.stderr)
+    return times, counters, reason
+
+
+def median_or_none(values):
+    return None if None in values else statistics.median(values)
+
+
+def print_counters(path, counters):
+    """Prints median counters of every phase with derived IPC and misses per
+    thousand instructions."""
+    for phase in PHASES:
+        med = {c: median_or_none(counters[phase][c]) for c in COUNTERS}
+        row = f"  {os.path.basename(path) + ' ' + phase:30}"
+        for c in COUNTERS:
+            row += f" {c}=" + ("n/a" if med[c] is None else "%.0f" % med[c])
+        insns = med["instructions"]
+        if insns and med["cycles"]:
+            row += " ipc=%.2f" % (insns / med["cycles"])
+        for c in ("l1d-misses", "llc-misses", "branch-misses"):
+            if insns and med[c] is not None:
+                row += " %s-pki=%.2f" % (c.replace("-misses", ""),
+                                          1000.0 * med[c] / insns)
+        print(row)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    common.add_common_args(parser)
+    parser.add_argument("--runs", type=int, default=5,
+                        help="runs per file; the median is reported")
+    parser.add_argument("--perf-counters", action="store_true",
+                        help="collect hardware counters around each phase")
+    parser.add_argument("--json", help="write all samples to this file")
+    parser.add_argument("corpus", nargs="*",
+                        help=".ll files or directories (default: bench/corpus)")
+    args = parser.parse_args()
+
+    results, unavailable = {}, None
+    columns = ("total",) + PHASES
+    print(f"{'file':32}" + "".join(f"{c + ' us':>14}" for c in columns))
+    with tempfile.TemporaryDirectory() as workdir:
+        trace = os.path.join(workdir, "trace.json")
+        for path in common.corpus_files(args.corpus):
+            samples = {c: [] for c in columns}
+            counters = {p: {c: [] for c in COUNTERS} for p in PHASES}
+            for _ in range(args.runs):
+                times, run_counters, reason = measure(args, path, trace)
+                for c, t in times.items():
+                    samples[c].append(t)
+                if run_counters is None:
+                    unavailable = unavailable or reason
+                    continue
+                for p in PHASES:
+                    for c in COUNTERS:
+                        counters[p][c].append(run_counters[p][c])
+            if args.perf_counters and not unavailable:
+                samples["perf"] = counters
+            results[path] = samples
+            print(f"{os.path.basename(path):32}" +
+                  "".join(f"{statistics.median(samples[c]):>14.0f}"
+                          for c in columns))
+            if "perf" in samples:
+                print_counters(path, counters)
+
+    if unavailable:
+        print(f"note: {unavailable}; timings only")
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
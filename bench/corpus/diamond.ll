@@ -0,0 +1,72 @@
+; Redundant arithmetic on both arms of if/else diamonds.
+
+define i32 @diamond(i32 %a, i32 %b) {
+entry:
+  %cmp = icmp ugt i32 %a, %b
+  br i1 %cmp, label %then, label %else
+
+then:
+  %m1 = mul i32 %a, %b
+  %s1 = add i32 %m1, %a
+  %r1 = xor i32 %s1, 7
+  br label %exit
+
+else:
+  %m2 = mul i32 %a, %b
+  %s2 = add i32 %m2, %a
+  %r2 = sub i32 %s2, %b
+  br label %exit
+
+exit:
+  %r = phi i32 [ %r1, %then ], [ %r2, %else ]
+  ret i32 %r
+}
+
+define i64 @nested_diamond(i64 %a, i64 %b, i64 %c) {
+entry:
+  %c0 = icmp slt i64 %a, %c
+  br i1 %c0, label %left, label %right
+
+left:
+  %c1 = icmp slt i64 %b, %c
+  br i1 %c1, label %ll, label %lr
+
+ll:
+  %m1 = mul i64 %a, %b
+  %x1 = shl i64 %m1, 3
+  br label %exit
+
+lr:
+  %m2 = mul i64 %a, %b
+  %x2 = ashr i64 %m2, 2
+  br label %exit
+
+right:
+  %m3 = mul i64 %a, %b
+  %x3 = add i64 %m3, %c
+  br label %exit
+
+exit:
+  %r = phi i64 [ %x1, %ll ], [ %x2, %lr ], [ %x3, %right ]
+  ret i64 %r
+}
+
+define double @fp_diamond(double %x, double %y) {
+entry:
+  %cmp = fcmp olt double %x, %y
+  br i1 %cmp, label %then, label %else
+
+then:
+  %p1 = fmul double %x, %y
+  %q1 = fadd double %p1, 1.000000e+00
+  br label %exit
+
+else:
+  %p2 = fmul double %x, %y
+  %q2 = fsub double %p2, %x
+  br label %exit
+
+exit:
+  %r = phi double [ %q1, %then ], [ %q2, %else ]
+  ret double %r
+}
@@ -0,0 +1,36 @@
+; Loop bodies recomputing an invariant expression on every path.
+
+define i32 @loop_invariant(i32 %a, i32 %n) {
+entry:
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %latch ]
+  %cmp = icmp slt i32 %i, %n
+  br i1 %cmp, label %body, label %exit
+
+body:
+  %odd = and i32 %i, 1
+  %isodd = icmp ne i32 %odd, 0
+  br i1 %isodd, label %odd.bb, label %even.bb
+
+odd.bb:
+  %m1 = mul i32 %a, %a
+  %t1 = add i32 %m1, %i
+  br label %latch
+
+even.bb:
+  %m2 = mul i32 %a, %a
+  %t2 = sub i32 %m2, %i
+  br label %latch
+
+latch:
+  %t = phi i32 [ %t1, %odd.bb ], [ %t2, %even.bb ]
+  %acc.next = add i32 %acc, %t
+  %i.next = add i32 %i, 1
+  br label %header
+
+exit:
+  ret i32 %acc
+}
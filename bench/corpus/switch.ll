@@ -0,0 +1,39 @@
+; Switch cases sharing decode arithmetic.
+
+define i32 @switch_decode(i32 %insn, i32 %acc) {
+entry:
+  %op = and i32 %insn, 3
+  switch i32 %op, label %default [
+    i32 0, label %case0
+    i32 1, label %case1
+    i32 2, label %case2
+  ]
+
+case0:
+  %a0 = lshr i32 %insn, 8
+  %b0 = and i32 %a0, 255
+  %r0 = add i32 %acc, %b0
+  br label %exit
+
+case1:
+  %a1 = lshr i32 %insn, 8
+  %b1 = and i32 %a1, 255
+  %r1 = sub i32 %acc, %b1
+  br label %exit
+
+case2:
+  %a2 = lshr i32 %insn, 8
+  %b2 = and i32 %a2, 255
+  %r2 = mul i32 %acc, %b2
+  br label %exit
+
+default:
+  %a3 = lshr i32 %insn, 8
+  %b3 = and i32 %a3, 255
+  %r3 = xor i32 %acc, %b3
+  br label %exit
+
+exit:
+  %r = phi i32 [ %r0, %case0 ], [ %r1, %case1 ], [ %r2, %case2 ], [ %r3, %default ]
+  ret i32 %r
+}
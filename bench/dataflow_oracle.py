@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Randomized property test of the dataflow engine against its oracle.
+
+Generates random CFGs (forward branches, switches with duplicated targets,
+loops, self-loops, joins with phis, loads the pass must not touch) whose
+blocks compute expressions drawn from a small pool, so identical expressions
+show up in many blocks. Every function is run through the pass with
+-hoist-anticipated-verify-dataflow, which checks the In/Out sets of every
+iteration against the simple reference solver in AnticipationOracle.cpp and
+aborts on the first difference, and with -hoist-anticipated-verify-touched,
+which checks the blocks it changed; opt's verifier then checks the whole
+hoisted function.
+
+  bench/dataflow_oracle.py --plugin build/HoistAnticipatedExpressions.so \\
+      [--count 500] [--blocks 12] [--seed 0] [--save DIR]
+
+Failing functions are written to --save (default: the current directory) as
+oracle-<seed>-<n>.ll and the exit status is non-zero.
+"""
+
+import argparse
+import os
+import random
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import common  # noqa: E402
+
+BATCH = 50
+ARGS = ("%a", "%b", "%c")
+OPS = ("add", "mul", "xor", "sub", "shl", "and")
+
+
+def random_function(name, rng, nblocks):
+    """Returns the IR of one random function."""
+    # Terminators first, so that the predecessors (and phis) are known.
+    succs = []
+    for k in range(nblocks):
+        fwd = list(range(k + 1, nblocks))
+        roll = rng.random()
+        if not fwd or roll < 0.05:
+            succs.append([])
+        elif roll < 0.35:
+            succs.append([rng.choice(fwd)])
+        elif roll < 0.55:
+            # One arm loops back (possibly to k itself), one leaves.
+            succs.append([rng.randint(0, k), rng.choice(fwd)])
+        elif roll < 0.75:
+            succs.append([rng.choice(fwd) for _ in range(rng.randint(2, 4))])
+        else:
+            succs.append(rng.sample(fwd, min(2, len(fwd))))
+    preds = [[] for _ in range(nblocks)]
+    for k, targets in enumerate(succs):
+        for t in targets:
+            preds[t].append(k)
+
+    out = [f"define i32 @{name}(i32 %a, i32 %b, i32 %c, ptr %p) {{",
+           "entry:", "  br label %b0"]
+    preds[0].append(None)
+    for k in range(nblocks):
+        out.append(f"b{k}:")
+        values = list(ARGS)
+        if len(preds[k]) > 1:
+            # One entry per edge, with the same value for repeated edges.
+            chosen = {p: rng.choice(ARGS) for p in preds[k]}
+            incoming = ", ".join(
+                f"[ {chosen[p]}, %{'entry' if p is None else f'b{p}'} ]"
+                for p in preds[k])
+            out.append(f"  %b{k}.phi = phi i32 {incoming}")
+            values.append(f"%b{k}.phi")
+        for i in range(rng.randint(0, 6)):
+            v = f"%b{k}.{i}"
+            if rng.random() < 0.1:
+                out.append(f"  {v} = load i32, ptr %p")
+            else:
+                op = rng.choice(OPS)
+                lhs = rng.choice(values[:4] if rng.random() < 0.7 else values)
+                rhs = rng.choice(ARGS + ("1", "2", "3"))
+                out.append(f"  {v} = {op} i32 {lhs}, {rhs}")
+            values.append(v)
+
+        targets = succs[k]
+        if not targets:
+            out.append(f"  ret i32 {rng.choice(values)}")
+        elif len(targets) == 1:
+            out.append(f"  br label %b{targets[0]}")
+        elif len(targets) == 2 and rng.random() < 0.7:
+            out.append(f"  %b{k}.cond = icmp ult i32 {rng.choice(values)}, "
+                       f"{rng.randint(0, 9)}")
+            out.append(f"  br i1 %b{k}.cond, label %b{targets[0]}, "
+                       f"label %b{targets[1]}")
+        else:
+            out.append(f"  switch i32 {rng.choice(values)}, "
+                       f"label %b{targets[0]} [")
+            out += [f"    i32 {v}, label %b{t}"
+                    for v, t in enumerate(targets[1:])]
+            out.append("  ]")
+    out.append("}")
+    return "\n".join(out) + "\n"
+
+
+def check(args, ir, workdir):
+    """Runs the checked pass on `ir`; returns its stderr on failure."""
+    path = os.path.join(workdir, "oracle.ll")
+    with open(path, "w") as f:
+        f.write(ir)
+    proc = common.run(common.opt_cmd(args, extra=[
+        "-hoist-anticipated-verify-dataflow",
+        "-hoist-anticipated-verify-touched", "-disable-output", path]),
+        check=False)
+    return proc.stderr if proc.returncode else None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    common.add_common_args(parser)
+    parser.add_argument("--count", type=int, default=500,
+                        help="random functions to check")
+    parser.add_argument("--blocks", type=int, default=12,
+                        help="maximum blocks per function")
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--save", default=".",
+                        help="directory for failing functions")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    functions = [random_function(f"f{n}", rng, rng.randint(2, args.blocks))
+                 for n in range(args.count)]
+    failures = 0
+    with tempfile.TemporaryDirectory() as workdir:
+        for start in range(0, len(functions), BATCH):
+            batch = functions[start:start + BATCH]
+            if check(args, "".join(batch), workdir) is None:
+                continue
+            # Narrow the batch down to the failing functions.
+            for n, ir in enumerate(batch, start):
+                error = check(args, ir, workdir)
+                if error is None:
+                    continue
+                failures += 1
+                path = os.path.join(args.save,
+                                    f"oracle-{args.seed}-{n}.ll")
+                with open(path, "w") as f:
+                    f.write(ir)
+                print(f"FAIL {path}")
+                print("\n".join("  " + line for line in
+                                error.splitlines()[:8]))
+    print(f"{args.count} functions, {failures} failure(s)")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
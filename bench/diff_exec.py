@@ -0,0 +1,276 @@
+#!/usr/bin/env python3
+"""Differential execution harness for hoist-anticipated-expressions.
+
+Every function in the corpus whose signature only uses scalar types is
+executed through `lli` on a set of generated inputs, once as written and once
+after the pass. The harness compares the results of both versions and
+records the execution time of each, so one run checks both correctness and
+the performance delta of every optimized function.
+
+  bench/diff_exec.py --plugin build/HoistAnticipatedExpressions.so \\
+      [--inputs 16] [--repeat 1000] [--runs 3] [--json out.json] [corpus...]
+
+Results of poison-producing inputs (e.g. an `add nsw` that overflows) are not
+constrained by the IR semantics and may legitimately differ; such mismatches
+should be inspected rather than trusted blindly. Inputs on which the original
+function traps are dropped.
+
+The exit status is non-zero if any function mismatches or only the
+transformed version crashes.
+"""
+
+import argparse
+import json
+import os
+import random
+import statistics
+import struct
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import common  # noqa: E402
+
+DRIVER = "__hae_driver"
+
+
+def int_literal(bits, rng):
+    """Returns an iN constant, biased towards edge values."""
+    lo, hi = -(1 << (bits - 1)), (1 << (bits - 1)) - 1
+    if bits == 1:
+        return rng.choice(["true", "false"])
+    edges = [0, 1, -1, 2, lo, hi, lo + 1, hi - 1]
+    if rng.random() < 0.3:
+        return str(rng.choice(edges))
+    return str(rng.randint(lo, hi))
+
+
+def fp_literal(ty, rng):
+    """Returns a half/float/double constant in LLVM's hexadecimal form."""
+    value = rng.choice([0.0, -0.0, 1.0, -1.0, 0.5]) if rng.random() < 0.3 \
+        else rng.uniform(-1000.0, 1000.0)
+    if ty == "half":
+        return "0xH%04X" % struct.unpack("<H", struct.pack("<e", value))[0]
+    if ty == "float":
+        value = struct.unpack("<f", struct.pack("<f", value))[0]
+    return "0x%016X" % struct.unpack("<Q", struct.pack("<d", value))[0]
+
+
+def literal(ty, rng):
+    if ty.startswith("i"):
+        return int_literal(int(ty[1:]), rng)
+    return fp_literal(ty, rng)
+
+
+def result_to_i64(ty, value, prefix):
+    """Returns IR converting `value` of type `ty` to i64 for printing, and
+    the name of the i64 value."""
+    if ty == "i64":
+        return "", value
+    if ty.startswith("i") and int(ty[1:]) < 64:
+        return f"  {prefix}.w = zext {ty} {value} to i64\n", f"{prefix}.w"
+    if ty.startswith("i"):
+        return f"  {prefix}.w = trunc {ty} {value} to i64\n", f"{prefix}.w"
+    width = {"half": "i16", "float": "i32", "double": "i64"}[ty]
+    ir = f"  {prefix}.b = bitcast {ty} {value} to {width}\n"
+    if width == "i64":
+        return ir, f"{prefix}.b"
+    return ir + f"  {prefix}.w = zext {width} {prefix}.b to i64\n", f"{prefix}.w"
+
+
+def driver_ir(name, ret, params, inputs, repeat):
+    """Builds a module whose entry point calls @name `repeat` times on every
+    input, printing the last result and the total time spent in the calls."""
+    out = [
+        '@fmt.res = private constant [16 x i8] c"RESULT %d %lld\\0A\\00"',
+        '@fmt.time = private constant [11 x i8] c"TIME %lld\\0A\\00"',
+        "declare i32 @printf(ptr, ...)",
+        "declare i32 @fflush(ptr)",
+        "declare i32 @clock_gettime(i32, ptr)",
+        f"declare {ret} @{name}({', '.join(params)})",
+        "",
+        f"define i32 @{DRIVER}() {{",
+        "entry:",
+        "  %ts0 = alloca { i64, i64 }",
+        "  %ts1 = alloca { i64, i64 }",
+        "  %total = alloca i64",
+        "  store i64 0, ptr %total",
+        "  br label %in0",
+    ]
+    for k, args in enumerate(inputs):
+        call_args = ", ".join(f"{t} {v}" for t, v in zip(params, args))
+        call = f"call {ret} @{name}({call_args})"
+        p = f"%r{k}"
+        out += [
+            f"in{k}:",
+            "  call i32 @clock_gettime(i32 1, ptr %ts0)",
+            f"  br label %loop{k}",
+            f"loop{k}:",
+            f"  %i{k} = phi i32 [ 0, %in{k} ], [ %i{k}.next, %loop{k} ]",
+            f"  {p} = {call}" if ret != "void" else f"  {call}",
+            f"  %i{k}.next = add i32 %i{k}, 1",
+            f"  %done{k} = icmp eq i32 %i{k}.next, {repeat}",
+            f"  br i1 %done{k}, label %print{k}, label %loop{k}",
+            f"print{k}:",
+            "  call i32 @clock_gettime(i32 1, ptr %ts1)",
+        ]
+        # Accumulate (ts1 - ts0) in nanoseconds.
+        for t in ("0", "1"):
+            out += [
+                f"  %s{k}.{t}.p = getelementptr {{ i64, i64 }}, ptr %ts{t}, i32 0, i32 0",
+                f"  %n{k}.{t}.p = getelementptr {{ i64, i64 }}, ptr %ts{t}, i32 0, i32 1",
+                f"  %s{k}.{t} = load i64, ptr %s{k}.{t}.p",
+                f"  %n{k}.{t} = load i64, ptr %n{k}.{t}.p",
+                f"  %sns{k}.{t} = mul i64 %s{k}.{t}, 1000000000",
+                f"  %ns{k}.{t} = add i64 %sns{k}.{t}, %n{k}.{t}",
+            ]
+        out += [
+            f"  %dt{k} = sub i64 %ns{k}.1, %ns{k}.0",
+            f"  %tot{k} = load i64, ptr %total",
+            f"  %tot{k}.next = add i64 %tot{k}, %dt{k}",
+            f"  store i64 %tot{k}.next, ptr %total",
+        ]
+        if ret == "void":
+            value = "0"
+        else:
+            conv, value = result_to_i64(ret, p, p)
+            out.append(conv.rstrip("\n"))
+        out += [
+            f"  call i32 (ptr, ...) @printf(ptr @fmt.res, i32 {k}, i64 {value})",
+            "  call i32 @fflush(ptr null)",
+            f"  br label %in{k + 1}",
+        ]
+    out += [
+        f"in{len(inputs)}:",
+        "  %t = load i64, ptr %total",
+        "  call i32 (ptr, ...) @printf(ptr @fmt.time, i64 %t)",
+        "  ret i32 0",
+        "}",
+    ]
+    return "\n".join(line for line in out if line) + "\n"
+
+
+def execute(args, module, name, ret, params, inputs, workdir):
+    """Links the driver into `module` and runs it once through lli.
+
+    Returns (results, time in ns or None, crashed). If the run crashes or
+    times out, results holds the inputs that finished before it did."""
+    drv = os.path.join(workdir, "driver.ll")
+    linked = os.path.join(workdir, "linked.bc")
+    with open(drv, "w") as f:
+        f.write(driver_ir(name, ret, params, inputs, args.repeat))
+    common.run([common.tool(args, "llvm-link"), module, drv, "-o", linked])
+    try:
+        proc = common.run([common.tool(args, "lli"),
+                           f"-entry-function={DRIVER}", linked],
+                          timeout=args.timeout, check=False)
+        stdout, crashed = proc.stdout, proc.returncode != 0
+    except subprocess.TimeoutExpired as exc:
+        # The driver flushes every result, so the output read before the
+        # kill ends with the last input that finished; the next one hung.
+        stdout, crashed = exc.stdout or "", True
+        if isinstance(stdout, bytes):
+            stdout = stdout.decode(errors="replace")
+    results, elapsed = [], None
+    for line in stdout.splitlines():
+        fields = line.split()
+        if not fields:
+            continue
+        if fields[0] == "RESULT":
+            results.append(fields[2])
+        elif fields[0] == "TIME":
+            elapsed = int(fields[1])
+    return results, elapsed, crashed
+
+
+def check_function(args, orig, new, name, ret, params, rng, workdir):
+    inputs = [[literal(t, rng) for t in params] for _ in range(args.inputs)]
+
+    # Drop inputs on which the original traps (e.g. division by zero) or
+    # hangs: the first input without a result.
+    while True:
+        expected, _, crashed = execute(args, orig, name, ret, params, inputs,
+                                       workdir)
+        if not crashed:
+            break
+        del inputs[len(expected)]
+        if not inputs:
+            return {"status": "SKIP", "reason": "original does not run"}
+
+    orig_times, new_times = [], []
+    for _ in range(args.runs):
+        expected, t, _ = execute(args, orig, name, ret, params, inputs, workdir)
+        orig_times.append(t)
+        actual, t, crashed = execute(args, new, name, ret, params, inputs,
+                                     workdir)
+        if crashed:
+            return {"status": "CRASH", "inputs": len(inputs)}
+        for k, (e, a) in enumerate(zip(expected, actual)):
+            if e != a:
+                return {"status": "MISMATCH", "input": inputs[k],
+                        "expected": e, "actual": a}
+        new_times.append(t)
+
+    return {"status": "OK", "inputs": len(inputs),
+            "orig_ns": statistics.median(orig_times),
+            "new_ns": statistics.median(new_times),
+            "orig_samples": orig_times, "new_samples": new_times}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    common.add_common_args(parser)
+    parser.add_argument("--inputs", type=int, default=16,
+                        help="generated inputs per function")
+    parser.add_argument("--repeat", type=int, default=1000,
+                        help="calls per input inside the timed loop")
+    parser.add_argument("--runs", type=int, default=3,
+                        help="lli runs per version; the median time is kept")
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--timeout", type=float, default=60.0,
+                        help="seconds allowed per lli run")
+    parser.add_argument("--json", help="write the results to this file")
+    parser.add_argument("corpus", nargs="*",
+                        help=".ll files or directories (default: bench/corpus)")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    records, failed = [], False
+    print(f"{'function':40} {'status':9} {'orig ns':>12} {'new ns':>12} "
+          f"{'delta':>8}")
+    for path in common.corpus_files(args.corpus):
+        with tempfile.TemporaryDirectory() as workdir:
+            new = os.path.join(workdir, "new.ll")
+            common.run(common.opt_cmd(args, extra=["-S", path, "-o", new]))
+            with open(path) as f:
+                ir = f.read()
+            for name, ret, params, linkage in common.scalar_functions(ir):
+                label = f"{os.path.basename(path)}:{name}"
+                if {"internal", "private"} & set(linkage):
+                    rec = {"status": "SKIP", "reason": "local linkage"}
+                else:
+                    rec = check_function(args, path, new, name, ret, params,
+                                         rng, workdir)
+                rec.update(file=path, function=name)
+                records.append(rec)
+                failed |= rec["status"] in ("MISMATCH", "CRASH")
+                delta = ""
+                if rec["status"] == "OK" and rec["orig_ns"]:
+                    delta = "%+.1f%%" % (100.0 * (rec["new_ns"] - rec["orig_ns"])
+                                         / rec["orig_ns"])
+                print(f"{label:40} {rec['status']:9} "
+                      f"{rec.get('orig_ns', ''):>12} {rec.get('new_ns', ''):>12} "
+                      f"{delta:>8}")
+                if rec["status"] == "MISMATCH":
+                    print(f"  input {rec['input']}: expected {rec['expected']},"
+                          f" got {rec['actual']}")
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(records, f, indent=2)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
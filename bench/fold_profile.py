@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+"""Folds sampled profiles through the provenance of hoisted instructions.
+
+After a hoist, the samples of the merged instruction land on its new location
+and can no longer be attributed to the branch arms it came from. Modules
+optimized with -hoist-anticipated-provenance record, on every hoisted
+instruction, the block and source location of each occurrence it replaced
+(!hoist.provenance). This script reads that metadata from the optimized
+module and redistributes the samples of every hoisted location evenly over
+the original locations:
+
+  opt -load-pass-plugin build/HoistAnticipatedExpressions.so \\
+      -passes=hoist-anticipated-expressions -hoist-anticipated-provenance \\
+      -S prog.ll -o prog.opt.ll        # built with -g
+  perf record ./prog && perf script -F ip,sym,srcline -G > perf.txt
+  bench/fold_profile.py --module prog.opt.ll perf.txt [--collapsed]
+
+Samples are keyed by function, source file and line, so the samples of a line
+can only be moved when every instruction on it was hoisted. Lines shared with
+instructions that were not hoisted keep their samples and are listed as
+shared. So does line 0, which a hoisted instruction whose occurrences had
+different lines carries, as code generation may put other instructions on it;
+--fold-line-0 moves its samples anyway when no other instruction of the
+function has it in the module. With --collapsed the output is in the
+`func;file:line count` format accepted by flame graph tools.
+"""
+
+import argparse
+import collections
+import os
+import re
+import sys
+
+_DEFINE = re.compile(r"^define\s.*?@(\"[^\"]+\"|[\w.$-]+)\(")
+_DEBUG_INTRINSIC = re.compile(r"call void @llvm\.dbg\.")
+_METADATA = re.compile(r"^!(\d+) = (?:distinct )?(.*)$")
+_ATTACHED = re.compile(r"!(dbg|hoist\.provenance) !(\d+)")
+_FIELD = re.compile(r"(\w+): (\"(?:[^\"\\]|\\.)*\"|[^,)]+)")
+_OPERAND = re.compile(r"!\"((?:[^\"\\]|\\.)*)\"|i32 (-?\d+)|!(\d+)")
+_SAMPLE_IP = re.compile(r"^\s*[0-9a-f]+\s+(\S+)")
+_SAMPLE_LINE = re.compile(r"^\s+(\S+):(\d+)$")
+
+
+def parse_fields(node):
+    """Fields of a specialized node such as !DILocation(line: 4, ...)."""
+    return {k: v.strip('"') for k, v in _FIELD.findall(node)}
+
+
+def scope_file(metadata, ref):
+    """Walks the scope chain from !ref up to a node with a file."""
+    while ref is not None and ref in metadata:
+        fields = parse_fields(metadata[ref])
+        if "file" in fields:
+            return parse_fields(metadata[fields["file"][1:]]).get("filename")
+        if metadata[ref].startswith("!DIFile"):
+            return fields.get("filename")
+        ref = fields.get("scope", "")[1:] or None
+    return None
+
+
+def location(metadata, ref):
+    """(file, line) of the !DILocation !ref."""
+    fields = parse_fields(metadata[ref])
+    return scope_file(metadata, fields["scope"][1:]), int(fields["line"])
+
+
+def read_provenance(path, fold_line_0):
+    """Returns ({(function, file, line): [(block, file, line)]} for every
+    hoisted instruction with a debug location, {the keys among them that are
+    also the location of an instruction that was not hoisted, and those of
+    line 0 unless fold_line_0})."""
+    with open(path) as f:
+        lines = f.read().splitlines()
+    metadata = {}
+    for line in lines:
+        m = _METADATA.match(line)
+        if m:
+            metadata[m.group(1)] = m.group(2)
+
+    origins = collections.defaultdict(list)
+    others = set()
+    func = None
+    for line in lines:
+        m = _DEFINE.match(line)
+        if m:
+            func = m.group(1).strip('"')
+            continue
+        attached = dict(_ATTACHED.findall(line))
+        if func is None or "dbg" not in attached or \
+                _DEBUG_INTRINSIC.search(line):
+            continue
+        file, lineno = location(metadata, attached["dbg"])
+        key = (func, os.path.basename(file or "??"), lineno)
+        if "hoist.provenance" not in attached:
+            others.add(key)
+            continue
+        for _, _, entry in _OPERAND.findall(metadata[attached["hoist.provenance"]]):
+            ops = _OPERAND.findall(metadata[entry])
+            block = ops[0][0]
+            if len(ops) >= 3:
+                origins[key].append((block, os.path.basename(ops[1][0]),
+                                     int(ops[2][1])))
+            else:
+                origins[key].append((block, "??", 0))
+    shared = {key for key in origins
+              if key in others or (key[2] == 0 and not fold_line_0)}
+    return origins, shared
+
+
+def read_samples(path):
+    """Counts `perf script -F ip,sym,srcline -G` samples per
+    (function, file, line)."""
+    counts = collections.Counter()
+    sym = None
+    with open(path) if path != "-" else sys.stdin as f:
+        for line in f:
+            line = line.rstrip("\n")
+            m = _SAMPLE_LINE.match(line)
+            if m and sym is not None:
+                counts[(sym, os.path.basename(m.group(1)),
+                        int(m.group(2)))] += 1
+                sym = None
+                continue
+            m = _SAMPLE_IP.match(line)
+            if m:
+                sym = m.group(1).split("+")[0]
+    return counts
+
+
+def fold(counts, origins, shared):
+    """Moves the samples of hoisted locations that are not shared to their
+    origins. Returns ({(function, file, line): samples}, {key: folded
+    samples})."""
+    folded = collections.Counter()
+    moved = collections.Counter()
+    for key, samples in counts.items():
+        if key not in origins or key in shared:
+            folded[key] += samples
+            continue
+        share = samples / len(origins[key])
+        for block, file, line in origins[key]:
+            target = (key[0], file, line)
+            folded[target] += share
+            moved[target] += share
+    return folded, moved
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--module", required=True,
+                        help="optimized .ll with !hoist.provenance metadata")
+    parser.add_argument("--collapsed", action="store_true",
+                        help="print func;file:line count lines")
+    parser.add_argument("--fold-line-0", action="store_true",
+                        help="also move the samples of line 0 when only "
+                             "hoisted instructions have it")
+    parser.add_argument("samples", help="perf script output ('-' for stdin)")
+    args = parser.parse_args()
+
+    origins, shared = read_provenance(args.module, args.fold_line_0)
+    counts = read_samples(args.samples)
+    folded, moved = fold(counts, origins, shared)
+    if args.collapsed:
+        for (func, file, line), samples in sorted(folded.items()):
+            print(f"{func};{file}:{line} {round(samples)}")
+        return 0
+
+    total = sum(folded.values()) or 1
+    print(f"{'function':24} {'location':24} {'samples':>10} {'share':>7}"
+          f" {'via hoist':>10}")
+    for (func, file, line), samples in folded.most_common():
+        print(f"{func:24} {file + ':' + str(line):24} {samples:>10.1f}"
+              f" {samples / total:>7.1%} {moved.get((func, file, line), 0):>10.1f}")
+    print(f"{len(origins)} hoisted location(s) with provenance")
+    for func, file, line in sorted(shared):
+        print(f"  {func} {file}:{line}: shared, "
+              f"{counts.get((func, file, line), 0)} sample(s) left in place")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
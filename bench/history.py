@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Benchmark history store with regression gating.
+
+`record` stores the outputs of bench/compile_time.py and bench/diff_exec.py
+as one JSON file per commit in bench/history/; `compare` checks two such
+records against each other and exits non-zero on a regression:
+
+  bench/history.py record --compile compile.json --runtime diff.json
+  bench/history.py compare [BASE [NEW]]
+
+BASE and NEW are git revisions (default HEAD~1 and HEAD), record names given
+to `record --commit`, or record files.
+Everything is local; no network access is needed.
+
+Noise model: every metric is a set of samples (one per benchmark run). Each
+side is summarized by its median together with a distribution-free
+confidence interval for the median, taken from order statistics. A metric
+regresses when the median grows by more than the threshold *and* the
+confidence intervals of both sides do not overlap; improvements are reported
+symmetrically. Lower is better for every metric (microseconds in the pass,
+nanoseconds in the generated code).
+"""
+
+import argparse
+import datetime
+import json
+import math
+import os
+import statistics
+import subprocess
+import sys
+
+HISTORY_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                           "history")
+
+
+def git(*args):
+    return subprocess.run(["git", *args], stdout=subprocess.PIPE,
+                          universal_newlines=True, check=True).stdout.strip()
+
+
+def head_commit():
+    commit = git("rev-parse", "HEAD")
+    if git("status", "--porcelain", "--untracked-files=no"):
+        commit += "-dirty"
+    return commit
+
+
+def record_path(directory, ref):
+    """Maps a record file, a record name or a git revision to the path of
+    its record."""
+    if os.path.isfile(ref):
+        return ref
+    named = os.path.join(directory, ref + ".json")
+    if os.path.isfile(named):
+        return named
+    try:
+        commit = git("rev-parse", "--verify", "--quiet", ref + "^{commit}")
+    except subprocess.CalledProcessError:
+        sys.exit(f"error: '{ref}' is neither a record nor a git revision")
+    return os.path.join(directory, commit + ".json")
+
+
+def median_ci(samples, confidence):
+    """Returns (median, low, high) where [low, high] covers the population
+    median with at least `confidence` probability (binomial order-statistic
+    interval; degenerates to [min, max] for very small sample counts)."""
+    xs = sorted(samples)
+    n = len(xs)
+    lo = 0
+    # Narrowest symmetric pair of ranks (lo, n - 1 - lo), i.e. the largest
+    # lo, that still reaches the requested coverage
+    # P(lo < #{x < median} <= n - 1 - lo); lo stays 0 if none does.
+    for j in range(n // 2, -1, -1):
+        coverage = sum(math.comb(n, i) for i in range(j + 1, n - j)) / 2 ** n
+        if coverage >= confidence:
+            lo = j
+            break
+    return statistics.median(xs), xs[lo], xs[n - 1 - lo]
+
+
+def cmd_record(args):
+    metrics = {}
+    if args.compile:
+        with open(args.compile) as f:
+            for path, samples in json.load(f).items():
+                metrics["compile/" + os.path.basename(path)] = samples["total"]
+    if args.runtime:
+        with open(args.runtime) as f:
+            for rec in json.load(f):
+                if rec["status"] == "OK":
+                    name = f"{os.path.basename(rec['file'])}:{rec['function']}"
+                    metrics["runtime/" + name] = rec["new_samples"]
+    if not metrics:
+        sys.exit("error: nothing to record; pass --compile and/or --runtime")
+
+    commit = args.commit or head_commit()
+    os.makedirs(args.dir, exist_ok=True)
+    path = os.path.join(args.dir, commit + ".json")
+    with open(path, "w") as f:
+        json.dump({"commit": commit,
+                   "date": datetime.datetime.now().isoformat(timespec="seconds"),
+                   "metrics": metrics}, f, indent=2)
+    print(f"recorded {len(metrics)} metrics in {path}")
+    return 0
+
+
+def cmd_compare(args):
+    records = []
+    for ref in (args.base, args.new):
+        path = record_path(args.dir, ref)
+        if not os.path.exists(path):
+            sys.exit(f"error: no benchmark record for '{ref}' ({path})")
+        with open(path) as f:
+            records.append(json.load(f)["metrics"])
+    base, new = records
+
+    regressions = 0
+    print(f"{'metric':48} {'base':>12} {'new':>12} {'change':>8}  verdict")
+    for name in sorted(set(base) & set(new)):
+        threshold = args.compile_threshold if name.startswith("compile/") \
+            else args.runtime_threshold
+        mb, lb, hb = median_ci(base[name], args.confidence)
+        mn, ln, hn = median_ci(new[name], args.confidence)
+        change = (mn - mb) / mb if mb else 0.0
+        verdict = "ok"
+        if change > threshold and ln > hb:
+            verdict = "REGRESSION"
+            regressions += 1
+        elif change < -threshold and hn < lb:
+            verdict = "improvement"
+        elif abs(change) > threshold:
+            verdict = "noise"
+        print(f"{name:48} {mb:>12.0f} {mn:>12.0f} {change:>+8.1%}  {verdict}")
+    for name in sorted(set(base) ^ set(new)):
+        print(f"{name:48} only in {'base' if name in base else 'new'}")
+
+    if regressions:
+        print(f"{regressions} regression(s) beyond the threshold")
+    return 1 if regressions else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--dir", default=HISTORY_DIR,
+                        help="history directory (default: bench/history)")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    rec = sub.add_parser("record", help="store results for a commit")
+    rec.add_argument("--compile", help="JSON output of bench/compile_time.py")
+    rec.add_argument("--runtime", help="JSON output of bench/diff_exec.py")
+    rec.add_argument("--commit", help="record name (default: HEAD)")
+    rec.set_defaults(func=cmd_record)
+
+    cmp = sub.add_parser("compare", help="gate NEW against BASE")
+    cmp.add_argument("base", nargs="?", default="HEAD~1")
+    cmp.add_argument("new", nargs="?", default="HEAD")
+    cmp.add_argument("--confidence", type=float, default=0.95)
+    cmp.add_argument("--compile-threshold", type=float, default=0.05,
+                     help="allowed relative compile-time growth")
+    cmp.add_argument("--runtime-threshold", type=float, default=0.03,
+                     help="allowed relative runtime growth")
+    cmp.set_defaults(func=cmd_compare)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
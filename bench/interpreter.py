@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""Dispatch-loop benchmark on a bytecode interpreter.
+
+bench/interpreter/interp.c is a register-machine interpreter: a loop around a
+large switch whose handlers all decode their operands from the instruction
+word and bump the instruction pointer. The script compiles it to IR with
+clang, without running the LLVM optimizer, and promotes it to SSA with the
+--prepare pipeline. On that module it measures
+
+  compile   the time spent inside the pass (its -time-trace events), per
+            phase, as bench/compile_time.py does;
+  hoists    the hoists the pass performs in the interpreter function;
+  runtime   the time the interpreter takes to run a fixed bytecode program
+            for --iterations rounds, built with the --pipeline optimization
+            pipeline with and without the pass in front of it, compiled with
+            llc and linked with clang. Both builds must print the same
+            checksum.
+
+  bench/interpreter.py --plugin build/HoistAnticipatedExpressions.so \\
+      [--runs 5] [--iterations 100000] [--json interp.json]
+
+--ir uses an already generated .ll file instead of running clang. The exit
+status is non-zero if the checksums differ.
+"""
+
+import argparse
+import json
+import os
+import re
+import statistics
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import common  # noqa: E402
+import compile_time  # noqa: E402
+
+SOURCE = os.path.join(common.REPO_ROOT, "bench", "interpreter", "interp.c")
+FUNCTION = "run"
+_REPORT_FN = re.compile(r"^Hoist report for function '(.*)':$")
+_REPORT_TOTAL = re.compile(r"^  function total: (\d+) hoists, ")
+
+
+def generate_ir(args, workdir):
+    """Returns the interpreter as SSA IR that has not been optimized yet."""
+    raw = args.ir
+    if not raw:
+        raw = os.path.join(workdir, "interp.raw.ll")
+        # -O2 without the LLVM passes keeps the functions optimizable (no
+        # optnone) while leaving the duplicated decode code in place.
+        common.run([common.tool(args, "clang"), "-O2", "-Xclang",
+                    "-disable-llvm-passes", "-emit-llvm", "-S", SOURCE,
+                    "-o", raw])
+    path = os.path.join(workdir, "interp.ll")
+    common.run([common.tool(args, "opt"), f"-passes={args.prepare}", "-S",
+                raw, "-o", path])
+    return path
+
+
+def count_hoists(args, path):
+    """Returns the hoists the pass performs in the interpreter function."""
+    proc = common.run(common.opt_cmd(
+        args, pipeline=f"print<{common.PASS_NAME}>",
+        extra=["-disable-output", path]))
+    func = None
+    for line in proc.stderr.splitlines():
+        m = _REPORT_FN.match(line)
+        if m:
+            func = m.group(1)
+        m = _REPORT_TOTAL.match(line)
+        if m and func == FUNCTION:
+            return int(m.group(1))
+    return 0
+
+
+def build(args, path, pipeline, exe, workdir):
+    """Optimizes `path` with `pipeline` and links it into `exe`."""
+    opt_ll = os.path.join(workdir, os.path.basename(exe) + ".ll")
+    obj = os.path.join(workdir, os.path.basename(exe) + ".o")
+    common.run(common.opt_cmd(args, pipeline=pipeline,
+                              extra=["-S", path, "-o", opt_ll]))
+    common.run([common.tool(args, "llc"), "-O2", "-relocation-model=pic",
+                "-filetype=obj", opt_ll, "-o", obj])
+    common.run([common.tool(args, "clang"), obj, "-o", exe])
+
+
+def execute(args, exe):
+    """Returns (checksum, nanoseconds) of one run of the interpreter."""
+    proc = common.run([exe, str(args.iterations)])
+    fields = dict(line.split(None, 1) for line in proc.stdout.splitlines())
+    return fields["RESULT"].strip(), int(fields["TIME"])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    common.add_common_args(parser)
+    parser.add_argument("--ir", help="use this .ll file instead of compiling "
+                                     "interp.c with clang")
+    parser.add_argument("--prepare",
+                        default="function(sroa,early-cse,simplifycfg)",
+                        help="pipeline bringing the clang output to SSA")
+    parser.add_argument("--pipeline", default="default<O2>",
+                        help="optimization pipeline of the runtime builds; "
+                             "the pass is added in front of it")
+    parser.add_argument("--runs", type=int, default=5,
+                        help="runs of each measurement; the median is kept")
+    parser.add_argument("--iterations", type=int, default=100000,
+                        help="rounds of the bytecode program per run")
+    parser.add_argument("--perf-counters", action="store_true",
+                        help="collect hardware counters around each phase")
+    parser.add_argument("--json", help="write all samples to this file")
+    args = parser.parse_args()
+
+    columns = ("total",) + compile_time.PHASES
+    with tempfile.TemporaryDirectory() as workdir:
+        path = generate_ir(args, workdir)
+        with open(path) as f:
+            insts = sum(1 for line in f if line.startswith("  ") and
+                        not line.lstrip().startswith(("br ", "ret ", ";")))
+
+        compile_samples = {c: [] for c in columns}
+        trace = os.path.join(workdir, "trace.json")
+        for _ in range(args.runs):
+            times, _, _ = compile_time.measure(args, path, trace)
+            for c, t in times.items():
+                compile_samples[c].append(t)
+        hoists = count_hoists(args, path)
+
+        before = os.path.join(workdir, "before")
+        after = os.path.join(workdir, "after")
+        build(args, path, args.pipeline, before, workdir)
+        build(args, path, f"function({common.PASS_NAME}),{args.pipeline}",
+              after, workdir)
+        runtime = {"before": [], "after": []}
+        checksums = {}
+        for _ in range(args.runs):
+            for name, exe in (("before", before), ("after", after)):
+                checksum, ns = execute(args, exe)
+                checksums.setdefault(name, checksum)
+                runtime[name].append(ns)
+
+    print(f"interpreter: {insts} instructions, {hoists} hoists in @{FUNCTION}")
+    print("compile " + " ".join(
+        f"{c}={statistics.median(compile_samples[c]):.0f}us" for c in columns))
+    orig = statistics.median(runtime["before"])
+    new = statistics.median(runtime["after"])
+    print(f"runtime before={orig:.0f}ns after={new:.0f}ns "
+          f"delta={100.0 * (new - orig) / orig:+.1f}%")
+    mismatch = checksums["before"] != checksums["after"]
+    if mismatch:
+        print(f"MISMATCH: checksum {checksums['before']} before, "
+              f"{checksums['after']} after")
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"instructions": insts, "hoists": hoists,
+                       "compile": compile_samples, "runtime": runtime,
+                       "checksums": checksums}, f, indent=2)
+    return 1 if mismatch else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
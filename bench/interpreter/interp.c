@@ -0,0 +1,207 @@
+/*
+ * A register-machine bytecode interpreter in the shape of production
+ * interpreters: one loop around a large switch whose handlers each decode
+ * their operands from the instruction word and bump the instruction pointer.
+ * That decode arithmetic is duplicated in every case, which is what
+ * hoist-anticipated-expressions can move into the dispatch block.
+ *
+ * Instructions are 32 bits: opcode in bits 0-7, then the operands A, B and C
+ * in one byte each; Bx is the 16-bit signed field covering B and C.
+ *
+ * Usage: interp [iterations]. Prints the checksum of the bytecode program and
+ * the nanoseconds spent in the interpreter as
+ *   RESULT <checksum>
+ *   TIME <ns>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+enum {
+  OP_HALT, OP_MOV, OP_LOADI, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_REM,
+  OP_AND, OP_OR, OP_XOR, OP_SHL, OP_SHR, OP_ADDI, OP_MULI, OP_SHLI,
+  OP_SHRI, OP_NEG, OP_NOT, OP_MIN, OP_MAX, OP_LOAD, OP_STORE, OP_LOADX,
+  OP_STOREX, OP_JMP, OP_JNZ, OP_JZ, OP_JLT, OP_JGE, OP_JEQ, OP_JNE,
+  OP_SEL, OP_INC, OP_DEC, OP_SWAP,
+};
+
+#define OP(i) ((i) & 0xff)
+#define A(i) (((i) >> 8) & 0xff)
+#define B(i) (((i) >> 16) & 0xff)
+#define C(i) (((i) >> 24) & 0xff)
+#define SC(i) ((int32_t)(i) >> 24)
+#define SBX(i) ((int32_t)(i) >> 16)
+
+#define ABC(op, a, b, c) \
+  ((uint32_t)(op) | (uint32_t)(a) << 8 | (uint32_t)(b) << 16 | \
+   (uint32_t)(uint8_t)(c) << 24)
+#define ABX(op, a, bx) \
+  ((uint32_t)(op) | (uint32_t)(a) << 8 | (uint32_t)(uint16_t)(bx) << 16)
+
+#define MEM_MASK 255
+
+/* Binary register handlers: R[A] = R[B] op R[C]. */
+#define BINARY(name, expr)                                                     \
+  case OP_##name: {                                                            \
+    int64_t b = R[B(i)], c = R[C(i)];                                          \
+    R[A(i)] = (expr);                                                          \
+    pc++;                                                                      \
+    break;                                                                     \
+  }
+
+/* Binary handlers with an immediate: R[A] = R[B] op SC. */
+#define IMMEDIATE(name, expr)                                                  \
+  case OP_##name: {                                                            \
+    int64_t b = R[B(i)], c = SC(i);                                            \
+    R[A(i)] = (expr);                                                          \
+    pc++;                                                                      \
+    break;                                                                     \
+  }
+
+/* Conditional branches: pc += 1 + SC if R[A] cmp R[B]. */
+#define BRANCH(name, cond)                                                     \
+  case OP_##name: {                                                            \
+    int64_t a = R[A(i)], b = R[B(i)];                                          \
+    pc += (cond) ? 1 + SC(i) : 1;                                              \
+    break;                                                                     \
+  }
+
+__attribute__((noinline)) int64_t run(const uint32_t *code, int64_t n) {
+  int64_t R[256] = {0};
+  int64_t mem[MEM_MASK + 1] = {0};
+  const uint32_t *pc = code;
+  R[0] = n;
+  for (;;) {
+    uint32_t i = *pc;
+    switch (OP(i)) {
+    case OP_HALT:
+      return R[A(i)];
+    case OP_MOV:
+      R[A(i)] = R[B(i)];
+      pc++;
+      break;
+    case OP_LOADI:
+      R[A(i)] = SBX(i);
+      pc++;
+      break;
+    BINARY(ADD, (int64_t)((uint64_t)b + (uint64_t)c))
+    BINARY(SUB, (int64_t)((uint64_t)b - (uint64_t)c))
+    BINARY(MUL, (int64_t)((uint64_t)b * (uint64_t)c))
+    BINARY(DIV, c == -1 ? (int64_t)(0 - (uint64_t)b) : c ? b / c : 0)
+    BINARY(REM, c && c != -1 ? b % c : 0)
+    BINARY(AND, b & c)
+    BINARY(OR, b | c)
+    BINARY(XOR, b ^ c)
+    BINARY(SHL, (int64_t)((uint64_t)b << (c & 63)))
+    BINARY(SHR, (int64_t)((uint64_t)b >> (c & 63)))
+    BINARY(MIN, b < c ? b : c)
+    BINARY(MAX, b > c ? b : c)
+    IMMEDIATE(ADDI, (int64_t)((uint64_t)b + (uint64_t)c))
+    IMMEDIATE(MULI, (int64_t)((uint64_t)b * (uint64_t)c))
+    IMMEDIATE(SHLI, (int64_t)((uint64_t)b << (c & 63)))
+    IMMEDIATE(SHRI, (int64_t)((uint64_t)b >> (c & 63)))
+    case OP_NEG:
+      R[A(i)] = (int64_t)(0 - (uint64_t)R[B(i)]);
+      pc++;
+      break;
+    case OP_NOT:
+      R[A(i)] = ~R[B(i)];
+      pc++;
+      break;
+    case OP_LOAD:
+      R[A(i)] = mem[R[B(i)] & MEM_MASK];
+      pc++;
+      break;
+    case OP_STORE:
+      mem[R[A(i)] & MEM_MASK] = R[B(i)];
+      pc++;
+      break;
+    case OP_LOADX:
+      R[A(i)] = mem[((uint64_t)R[B(i)] + (uint64_t)R[C(i)]) & MEM_MASK];
+      pc++;
+      break;
+    case OP_STOREX:
+      mem[((uint64_t)R[A(i)] + (uint64_t)R[C(i)]) & MEM_MASK] = R[B(i)];
+      pc++;
+      break;
+    case OP_JMP:
+      pc += 1 + SBX(i);
+      break;
+    case OP_JNZ:
+      pc += R[A(i)] ? 1 + SBX(i) : 1;
+      break;
+    case OP_JZ:
+      pc += R[A(i)] ? 1 : 1 + SBX(i);
+      break;
+    BRANCH(JLT, a < b)
+    BRANCH(JGE, a >= b)
+    BRANCH(JEQ, a == b)
+    BRANCH(JNE, a != b)
+    case OP_SEL:
+      R[A(i)] = R[A(i)] ? R[B(i)] : R[C(i)];
+      pc++;
+      break;
+    case OP_INC:
+      R[A(i)] = R[A(i)] + 1;
+      pc++;
+      break;
+    case OP_DEC:
+      R[A(i)] = R[A(i)] - 1;
+      pc++;
+      break;
+    case OP_SWAP: {
+      int64_t t = R[A(i)];
+      R[A(i)] = R[B(i)];
+      R[B(i)] = t;
+      pc++;
+      break;
+    }
+    default:
+      abort();
+    }
+  }
+}
+
+/*
+ * The benchmark program: for R0 rounds, fill a 64-entry table from a linear
+ * congruential generator and fold it into a checksum, with a data-dependent
+ * branch per element.
+ */
+static uint32_t program[] = {
+    ABX(OP_LOADI, 1, 0),       /*  0: i = 0 */
+    ABX(OP_LOADI, 2, 0),       /*  1: acc = 0 */
+    ABX(OP_LOADI, 3, 12345),   /*  2: x = seed */
+    ABX(OP_LOADI, 4, 1103),    /*  3: multiplier */
+    ABX(OP_LOADI, 7, 64),      /*  4: table size */
+    ABX(OP_LOADI, 6, 0),       /*  5: outer: j = 0 */
+    ABC(OP_MUL, 3, 3, 4),      /*  6: inner: x = x * multiplier */
+    ABC(OP_ADDI, 3, 3, 12),    /*  7: x += 12 */
+    ABC(OP_STOREX, 6, 3, 1),   /*  8: mem[j + i] = x */
+    ABC(OP_LOADX, 5, 6, 1),    /*  9: t = mem[j + i] */
+    ABC(OP_SHRI, 8, 5, 7),     /* 10: u = t >> 7 */
+    ABC(OP_AND, 9, 8, 7),      /* 11: u &= table size */
+    ABX(OP_JZ, 9, 1),          /* 12: if u: */
+    ABC(OP_XOR, 2, 2, 5),      /* 13:   acc ^= t */
+    ABC(OP_ADD, 2, 2, 8),      /* 14: acc += u */
+    ABC(OP_SHLI, 10, 2, 3),    /* 15: v = acc << 3 */
+    ABC(OP_SUB, 2, 10, 2),     /* 16: acc = v - acc */
+    ABC(OP_ADDI, 6, 6, 1),     /* 17: j++ */
+    ABC(OP_JLT, 6, 7, -13),    /* 18: if j < size: goto inner */
+    ABC(OP_ADDI, 1, 1, 1),     /* 19: i++ */
+    ABC(OP_JLT, 1, 0, -16),    /* 20: if i < rounds: goto outer */
+    ABC(OP_HALT, 2, 0, 0),     /* 21: return acc */
+};
+
+int main(int argc, char **argv) {
+  int64_t n = argc > 1 ? atoll(argv[1]) : 100000;
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  int64_t result = run(program, n);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf("RESULT %lld\n", (long long)result);
+  printf("TIME %lld\n", (long long)(t1.tv_sec - t0.tv_sec) * 1000000000LL +
+                            (t1.tv_nsec - t0.tv_nsec));
+  return 0;
+}
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Static throughput comparison of hot blocks with llvm-mca.
+
+Compiles every corpus file to assembly with `llc`, once as written and once
+after the pass, extracts the hot region of every function and simulates it
+with `llvm-mca` for several CPU models. The hot region is every block whose
+frequency (print<block-freq> on the same module) is at least --hot-fraction
+of the hottest block's; machine blocks llc creates without an IR block take
+the frequency of the block laid out before them. The blocks of a region are
+simulated as one straight-line sequence, as llvm-mca ignores branches. Per
+CPU it reports, before and after:
+
+  rthru     the Block RThroughput of the region (resource bound, cycles)
+  c/iter    cycles per iteration over --iterations simulated iterations,
+            which includes loop-carried dependency chains
+  latency   total cycles of a single iteration, i.e. the critical path
+
+Next to it the hoists and weighted cycles saved that the pass itself
+estimates from TTI (print<hoist-anticipated-expressions>) are shown, so its
+profitability decisions can be checked against a scheduling model without
+the target hardware.
+
+  bench/mca_compare.py --plugin build/HoistAnticipatedExpressions.so \\
+      [--cpu x86_64-unknown-linux-gnu:skylake ...] [--json mca.json] \\
+      [corpus...]
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import common  # noqa: E402
+
+DEFAULT_CPUS = (
+    "x86_64-unknown-linux-gnu:skylake",
+    "x86_64-unknown-linux-gnu:znver3",
+    "aarch64-unknown-linux-gnu:cortex-a57",
+    "aarch64-unknown-linux-gnu:cortex-a55",
+)
+METRICS = ("rthru", "c/iter", "latency")
+
+_TYPE = re.compile(r"^\s*\.type\s+([\w.$]+),\s*[@%]function")
+_BLOCK = re.compile(r"^(\.LBB\w+:|\s*(#|//) %bb\.\d+:)")
+_IR_BLOCK = re.compile(r"(?:#|//) %([\w.$-]+)\s*$")
+_BFI_FN = re.compile(r"^block-frequency-info: (.*)$")
+_BFI_BLOCK = re.compile(r"^ - (.*): float = ([\d.e+-]+)")
+_REPORT_FN = re.compile(r"^Hoist report for function '(.*)':$")
+_REPORT_TOTAL = re.compile(
+    r"^  function total: (\d+) hoists, (-?[\d.]+) weighted cycles saved$")
+
+
+def block_frequencies(args, path):
+    """Returns {function: {IR block: frequency relative to the entry}}."""
+    proc = common.run([common.tool(args, "opt"), "-passes=print<block-freq>",
+                       "-disable-output", path])
+    freqs, func = {}, None
+    for line in (proc.stderr + proc.stdout).splitlines():
+        m = _BFI_FN.match(line)
+        if m:
+            func = freqs.setdefault(m.group(1), {})
+            continue
+        m = _BFI_BLOCK.match(line)
+        if m and func is not None:
+            func[m.group(1)] = float(m.group(2))
+    return freqs
+
+
+def hot_regions(asm, freqs, hot_fraction):
+    """Returns {function: (region description, [instructions])}."""
+    functions = {m.group(1) for m in map(_TYPE.match, asm.splitlines()) if m}
+    regions, blocks, func = {}, [], None
+    for line in asm.splitlines():
+        label = line.split(":", 1)[0]
+        if func is None:
+            if label in functions:
+                func, blocks = label, [[None, []]]
+            continue
+        if line.startswith(".Lfunc_end"):
+            regions[func] = hot_blocks(blocks, freqs.get(func, {}),
+                                       hot_fraction)
+            func = None
+        elif _BLOCK.match(line):
+            m = _IR_BLOCK.search(line)
+            blocks.append([m.group(1) if m else None, []])
+        else:
+            inst = line.strip()
+            if inst and not inst.startswith((".", "#", "//")) and \
+                    not inst.endswith(":"):
+                blocks[-1][1].append(inst)
+    return regions
+
+
+def hot_blocks(blocks, freqs, hot_fraction):
+    """Returns the region description and the instructions of the blocks of
+    one function ([IR block or None, [instructions]] in layout order) that are
+    at least hot_fraction as frequent as the hottest."""
+    # Code before the first block label belongs to the entry block, which
+    # print<block-freq> lists first.
+    weights, last = [], next(iter(freqs.values()), 1.0)
+    for name, _ in blocks:
+        last = freqs.get(name, last)
+        weights.append(last)
+    threshold = hot_fraction * max(weights)
+    hot = [body for w, (_, body) in zip(weights, blocks) if w >= threshold]
+    insts = [i for body in hot for i in body]
+    return f"{len(hot)}/{len(blocks)} blocks", insts
+
+
+def run_mca(args, triple, cpu, insts, iterations, workdir):
+    """Returns the llvm-mca summary numbers for one region."""
+    path = os.path.join(workdir, "region.s")
+    with open(path, "w") as f:
+        f.write("\n".join(insts) + "\n")
+    out = common.run([common.tool(args, "llvm-mca"), f"-mtriple={triple}",
+                      f"-mcpu={cpu}", f"-iterations={iterations}", path]).stdout
+    summary = {}
+    for line in out.splitlines():
+        key, _, value = line.partition(":")
+        if key in ("Iterations", "Total Cycles", "Block RThroughput"):
+            summary[key] = float(value)
+    return summary
+
+
+def measure(args, triple, cpu, insts, workdir):
+    steady = run_mca(args, triple, cpu, insts, args.iterations, workdir)
+    single = run_mca(args, triple, cpu, insts, 1, workdir)
+    return {"rthru": steady["Block RThroughput"],
+            "c/iter": steady["Total Cycles"] / steady["Iterations"],
+            "latency": single["Total Cycles"]}
+
+
+def tti_estimates(args, path):
+    """Returns {function: (hoists, weighted cycles saved)} as estimated by the
+    pass's own what-if report."""
+    proc = common.run(common.opt_cmd(
+        args, pipeline=f"print<{common.PASS_NAME}>",
+        extra=["-disable-output", path]))
+    estimates, func = {}, None
+    for line in proc.stderr.splitlines():
+        m = _REPORT_FN.match(line)
+        if m:
+            func = m.group(1)
+        m = _REPORT_TOTAL.match(line)
+        if m and func:
+            estimates[func] = (int(m.group(1)), float(m.group(2)))
+    return estimates
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    common.add_common_args(parser)
+    parser.add_argument("--cpu", action="append", metavar="TRIPLE:CPU",
+                        help="target and CPU model to simulate (default: "
+                             "Skylake, Zen 3, Cortex-A57 and Cortex-A55)")
+    parser.add_argument("--iterations", type=int, default=100,
+                        help="iterations simulated for c/iter")
+    parser.add_argument("--hot-fraction", type=float, default=0.5,
+                        help="the hot region holds the blocks at least this "
+                             "fraction as frequent as the hottest one")
+    parser.add_argument("--json", help="write the results to this file")
+    parser.add_argument("corpus", nargs="*",
+                        help=".ll files or directories (default: bench/corpus)")
+    args = parser.parse_args()
+
+    cpus = [c.split(":", 1) for c in args.cpu or DEFAULT_CPUS]
+    records = []
+    print(f"{'function':32} {'cpu':12} {'region':13}" +
+          "".join(f"{m:>15}" for m in METRICS) + f"{'hoists':>8}{'tti':>9}")
+    for path in common.corpus_files(args.corpus):
+        estimates = tti_estimates(args, path)
+        with tempfile.TemporaryDirectory() as workdir:
+            new = os.path.join(workdir, "new.ll")
+            common.run(common.opt_cmd(args, extra=["-S", path, "-o", new]))
+            module_freqs = [block_frequencies(args, m) for m in (path, new)]
+            for triple, cpu in cpus:
+                regions = []
+                for module, freqs in zip((path, new), module_freqs):
+                    asm = common.run([common.tool(args, "llc"), "-O2",
+                                      f"-mtriple={triple}", f"-mcpu={cpu}",
+                                      module, "-o", "-"]).stdout
+                    regions.append(hot_regions(asm, freqs, args.hot_fraction))
+                before_regions, after_regions = regions
+                for func in sorted(before_regions):
+                    kind, before_insts = before_regions[func]
+                    _, after_insts = after_regions.get(func, (kind, []))
+                    if not before_insts or not after_insts:
+                        continue
+                    before = measure(args, triple, cpu, before_insts, workdir)
+                    after = measure(args, triple, cpu, after_insts, workdir)
+                    hoists, saved = estimates.get(func, (0, 0.0))
+                    records.append({"file": path, "function": func,
+                                    "triple": triple, "cpu": cpu,
+                                    "region": kind, "before": before,
+                                    "after": after, "hoists": hoists,
+                                    "tti_saved": saved})
+                    row = (f"{os.path.basename(path) + ':' + func:32} "
+                           f"{cpu:12} {kind:13}")
+                    for m in METRICS:
+                        row += f"{before[m]:>7.2f} {after[m] - before[m]:>+7.2f}"
+                    print(row + f"{hoists:>8}{saved:>9.2f}")
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(records, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""Loop vectorizer interaction benchmark.
+
+bench/vectorize/kernels.c holds loops whose bodies branch between two arms
+that repeat part of their work, which keeps the loop vectorizer from
+if-converting them cheaply. The script compiles the kernels to IR with clang,
+without running the LLVM optimizer, promotes them to SSA with the --prepare
+pipeline, and builds them with the --pipeline optimization pipeline once per
+pipeline position of the pass:
+
+  none              without the pass;
+  front             the pass in front of the pipeline;
+  peephole, scalar-late, vectorizer-start, optimizer-last
+                    the pass added at that extension point of the default
+                    pipelines (-hoist-anticipated-pipeline-position); at
+                    vectorizer-start it runs in vectorization-friendly mode.
+
+For every position it reports the loops the loop vectorizer vectorized (its
+-pass-remarks) and the median runtime of every kernel over --runs runs of
+--iterations rounds, relative to the first position listed. All builds must
+print the same checksums.
+
+  bench/vectorize.py --plugin build/HoistAnticipatedExpressions.so \\
+      [--runs 5] [--iterations 1000] [--positions none,vectorizer-start] \\
+      [--json vectorize.json]
+
+--ir uses an already generated .ll file instead of running clang. The exit
+status is non-zero if any checksum differs.
+"""
+
+import argparse
+import json
+import os
+import re
+import statistics
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import common  # noqa: E402
+
+SOURCE = os.path.join(common.REPO_ROOT, "bench", "vectorize", "kernels.c")
+POSITIONS = ("none", "front", "peephole", "scalar-late", "vectorizer-start",
+             "optimizer-last")
+_VECTORIZED = re.compile(r"remark: .*vectorized loop \(vectorization width")
+
+
+def generate_ir(args, workdir):
+    """Returns the kernels as SSA IR that has not been optimized yet."""
+    raw = args.ir
+    if not raw:
+        raw = os.path.join(workdir, "kernels.raw.ll")
+        common.run([common.tool(args, "clang"), "-O2", "-Xclang",
+                    "-disable-llvm-passes", "-emit-llvm", "-S", SOURCE,
+                    "-o", raw])
+    path = os.path.join(workdir, "kernels.ll")
+    common.run([common.tool(args, "opt"), f"-passes={args.prepare}", "-S",
+                raw, "-o", path])
+    return path
+
+
+def build(args, path, position, workdir):
+    """Optimizes `path` with the pass at `position` and links it. Returns
+    (executable, loops vectorized)."""
+    pipeline = args.pipeline
+    extra = ["-pass-remarks=loop-vectorize"]
+    if position == "front":
+        pipeline = f"function({common.PASS_NAME}),{pipeline}"
+    elif position != "none":
+        extra.append(f"-hoist-anticipated-pipeline-position={position}")
+    cpu = [f"-mcpu={args.mcpu}"] if args.mcpu else []
+    exe = os.path.join(workdir, position)
+    opt_ll, obj = exe + ".ll", exe + ".o"
+    proc = common.run(common.opt_cmd(args, pipeline=pipeline,
+                                     extra=extra + cpu +
+                                     ["-S", path, "-o", opt_ll]))
+    vectorized = sum(1 for line in proc.stderr.splitlines()
+                     if _VECTORIZED.search(line))
+    common.run([common.tool(args, "llc"), "-O2", "-relocation-model=pic",
+                "-filetype=obj", *cpu, opt_ll, "-o", obj])
+    common.run([common.tool(args, "clang"), obj, "-o", exe])
+    return exe, vectorized
+
+
+def execute(args, exe):
+    """Returns {kernel: (checksum, nanoseconds)} of one run."""
+    proc = common.run([exe, str(args.iterations)])
+    results = {}
+    for line in proc.stdout.splitlines():
+        fields = line.split()
+        if fields and fields[0] == "KERNEL":
+            results[fields[1]] = (fields[2], int(fields[3]))
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    common.add_common_args(parser)
+    parser.add_argument("--ir", help="use this .ll file instead of compiling "
+                                     "kernels.c with clang")
+    parser.add_argument("--prepare",
+                        default="function(sroa,early-cse,simplifycfg)",
+                        help="pipeline bringing the clang output to SSA")
+    parser.add_argument("--pipeline", default="default<O2>",
+                        help="optimization pipeline the pass is placed in")
+    parser.add_argument("--positions", default=",".join(POSITIONS),
+                        help="comma-separated pipeline positions to build "
+                             f"(default: all of {', '.join(POSITIONS)})")
+    parser.add_argument("--mcpu", help="target CPU for opt and llc, e.g. "
+                                       "native or skylake")
+    parser.add_argument("--runs", type=int, default=5,
+                        help="runs of each build; the median is kept")
+    parser.add_argument("--iterations", type=int, default=1000,
+                        help="rounds of every kernel per run")
+    parser.add_argument("--json", help="write all samples to this file")
+    args = parser.parse_args()
+
+    positions = args.positions.split(",")
+    unknown = [p for p in positions if p not in POSITIONS]
+    if unknown:
+        parser.error(f"unknown position(s): {', '.join(unknown)}")
+
+    vectorized = {}
+    runtime = {}
+    checksums = {}
+    with tempfile.TemporaryDirectory() as workdir:
+        path = generate_ir(args, workdir)
+        exes = {}
+        for position in positions:
+            exes[position], vectorized[position] = build(args, path, position,
+                                                         workdir)
+            runtime[position] = {}
+        # Interleave the builds so that drift in machine load hits all alike.
+        for _ in range(args.runs):
+            for position, exe in exes.items():
+                for kernel, (checksum, ns) in execute(args, exe).items():
+                    runtime[position].setdefault(kernel, []).append(ns)
+                    checksums.setdefault(kernel, {}).setdefault(position,
+                                                                checksum)
+
+    kernels = sorted(checksums)
+    base = positions[0]
+    width = max(len(p) for p in ("position",) + tuple(positions))
+    print(f"{'position':<{width}} vectorized " +
+          " ".join(f"{k:>22}" for k in kernels))
+    for position in positions:
+        cells = []
+        for kernel in kernels:
+            ns = statistics.median(runtime[position][kernel])
+            orig = statistics.median(runtime[base][kernel])
+            cells.append(f"{ns / 1e6:9.2f}ms {100.0 * (ns - orig) / orig:+6.1f}%")
+        print(f"{position:<{width}} {vectorized[position]:>10} " +
+              " ".join(f"{c:>22}" for c in cells))
+
+    mismatch = False
+    for kernel in kernels:
+        seen = checksums[kernel]
+        if len(set(seen.values())) > 1:
+            mismatch = True
+            print(f"MISMATCH: {kernel} checksums " + ", ".join(
+                f"{p}={c}" for p, c in seen.items()))
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"vectorized": vectorized, "runtime": runtime,
+                       "checksums": checksums}, f, indent=2)
+    return 1 if mismatch else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
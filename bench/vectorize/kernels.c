@@ -0,0 +1,116 @@
+/*
+ * Loop kernels whose bodies branch between two arms that repeat part of their
+ * work. Each loop only becomes cheap to vectorize once the repeated part is
+ * computed above the branch: a division in both arms has to be predicated
+ * (or scalarized) while it sits in them, and arithmetic duplicated in both
+ * arms is executed twice once the loop is if-converted.
+ *
+ * Usage: kernels [iterations]. Runs every kernel over fixed inputs and prints
+ * one line per kernel with the checksum of its output and the nanoseconds it
+ * took:
+ *   KERNEL <name> <checksum> <ns>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define N 4096
+
+/* A division and remainder by a runtime divisor in both arms. The divisor is
+ * odd, hence non-zero, so the division may be computed above the branch. */
+__attribute__((noinline)) void div_arms(uint32_t *restrict out,
+                                        const uint32_t *restrict a,
+                                        const uint8_t *restrict flag,
+                                        uint32_t d, int n) {
+  d |= 1;
+  for (int i = 0; i < n; i++) {
+    if (flag[i])
+      out[i] = a[i] / d + a[i] % d;
+    else
+      out[i] = a[i] / d - a[i] % d;
+  }
+}
+
+/* The same product and sum in both arms, followed by different tails. */
+__attribute__((noinline)) void mul_arms(uint32_t *restrict out,
+                                        const uint32_t *restrict a,
+                                        const uint32_t *restrict b,
+                                        const uint8_t *restrict flag, int n) {
+  for (int i = 0; i < n; i++) {
+    uint32_t x;
+    if (flag[i]) {
+      x = a[i] * b[i] + (a[i] ^ b[i]);
+      x = x * 3 + 1;
+    } else {
+      x = a[i] * b[i] + (a[i] ^ b[i]);
+      x = (x >> 2) - b[i];
+    }
+    out[i] = x;
+  }
+}
+
+/* Field extraction shared by both arms, as in a packet parser. */
+__attribute__((noinline)) void field_arms(uint32_t *restrict out,
+                                          const uint32_t *restrict word,
+                                          int n) {
+  for (int i = 0; i < n; i++) {
+    uint32_t w = word[i];
+    if (w & 0x80000000u)
+      out[i] = ((w >> 8) & 0xfff) * 5 + (w & 0xff);
+    else
+      out[i] = ((w >> 8) & 0xfff) * 5 - (w >> 20);
+  }
+}
+
+static uint32_t state = 12345;
+
+static uint32_t next(void) {
+  state = state * 1103515245u + 12345u;
+  return state;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t checksum(const uint32_t *v, int n) {
+  uint32_t sum = 0;
+  for (int i = 0; i < n; i++)
+    sum = sum * 31 + v[i];
+  return sum;
+}
+
+static uint32_t a[N], b[N], out[N];
+static uint8_t flag[N];
+
+int main(int argc, char **argv) {
+  long iterations = argc > 1 ? atol(argv[1]) : 1000;
+  for (int i = 0; i < N; i++) {
+    a[i] = next();
+    b[i] = next() >> 7;
+    flag[i] = next() >> 31;
+  }
+
+  uint64_t start = now_ns();
+  for (long k = 0; k < iterations; k++)
+    div_arms(out, a, flag, (uint32_t)k + 6, N);
+  printf("KERNEL div_arms %u %llu\n", checksum(out, N),
+         (unsigned long long)(now_ns() - start));
+
+  start = now_ns();
+  for (long k = 0; k < iterations; k++)
+    mul_arms(out, a, b, flag, N);
+  printf("KERNEL mul_arms %u %llu\n", checksum(out, N),
+         (unsigned long long)(now_ns() - start));
+
+  start = now_ns();
+  for (long k = 0; k < iterations; k++)
+    field_arms(out, a, N);
+  printf("KERNEL field_arms %u %llu\n", checksum(out, N),
+         (unsigned long long)(now_ns() - start));
+  return 0;
+}
@@ -0,0 +1,144 @@
+//===----------------------------------------------------------------------===//
+//
+// HoistAnticipatedExpressionsFuzzer - libFuzzer target that hunts for crashes
+// and compile-time cliffs in HoistAnticipatedExpressionsPass.
+//
+// Inputs are bitcode modules. The custom mutator changes them with the
+// FuzzMutate IR strategies (new instructions, branches, phis, functions, ...)
+// so every unit stays valid IR. Every unit is run through the pass, which is
+// linked into the fuzzer directly, and the fuzzer aborts when:
+//   * the pass crashes or produces invalid IR, or
+//   * the pass alone takes longer than -hoist-fuzz-budget-ms.
+// libFuzzer then saves the input as a crash artifact. Inputs on which the pass
+// does not terminate are caught by libFuzzer's own -timeout.
+//
+// Run (options after -ignore_remaining_args=1 are LLVM options):
+//   hoist-anticipated-expressions-fuzzer CORPUS -timeout=10 \
+//       -ignore_remaining_args=1 -hoist-fuzz-budget-ms=1000
+//
+// fuzz/run_fuzzer.py seeds the corpus, runs the fuzzer, and minimizes the
+// artifacts into fuzz/regressions.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/FuzzMutate/FuzzerCLI.h"
+#include "llvm/FuzzMutate/IRMutator.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdlib>
+
+using namespace llvm;
+
+// Defined by HoistAnticipatedExpressions.cpp, which is linked in.
+extern "C" PassPluginLibraryInfo llvmGetPassPluginInfo();
+
+static cl::opt<unsigned> BudgetMs(
+    "hoist-fuzz-budget-ms", cl::init(1000),
+    cl::desc("Abort when hoist-anticipated-expressions takes longer than "
+             "this many milliseconds on one input"));
+
+static std::unique_ptr<IRMutator> Mutator;
+
+static std::unique_ptr<IRMutator> createMutator() {
+  std::vector<TypeGetter> Types{
+      Type::getInt1Ty,  Type::getInt8Ty,  Type::getInt16Ty, Type::getInt32Ty,
+      Type::getInt64Ty, Type::getFloatTy, Type::getDoubleTy};
+
+  // Control-flow strategies matter most here: the pass only does anything
+  // when identical expressions appear on several paths.
+  std::vector<std::unique_ptr<IRMutationStrategy>> Strategies;
+  Strategies.push_back(std::make_unique<InjectorIRStrategy>(
+      InjectorIRStrategy::getDefaultOps()));
+  Strategies.push_back(std::make_unique<InstDeleterIRStrategy>());
+  Strategies.push_back(std::make_unique<InstModificationIRStrategy>());
+  Strategies.push_back(std::make_unique<InsertFunctionStrategy>());
+  Strategies.push_back(std::make_unique<InsertCFGStrategy>());
+  Strategies.push_back(std::make_unique<InsertPHIStrategy>());
+  Strategies.push_back(std::make_unique<SinkInstructionStrategy>());
+  Strategies.push_back(std::make_unique<ShuffleBlockStrategy>());
+
+  return std::make_unique<IRMutator>(std::move(Types), std::move(Strategies));
+}
+
+extern "C" LLVM_ATTRIBUTE_USED size_t LLVMFuzzerCustomMutator(
+    uint8_t *Data, size_t Size, size_t MaxSize, unsigned int Seed) {
+  LLVMContext Context;
+  std::unique_ptr<Module> M;
+  if (Size > 1)
+    M = parseModule(Data, Size, Context);
+  // libFuzzer starts from an empty unit when the corpus is empty, and a
+  // hand-added file or a crossover need not be valid bitcode: start over
+  // from an empty module then.
+  if (!M || verifyModule(*M, &errs()))
+    M = std::make_unique<Module>("M", Context);
+
+  Mutator->mutateModule(*M, Seed, MaxSize);
+
+  if (verifyModule(*M, &errs())) {
+    errs() << "mutation produced an invalid module\n";
+    M->print(errs(), nullptr);
+    abort();
+  }
+  return writeModule(*M, Data, MaxSize);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+  if (Size <= 1)
+    return 0;
+
+  LLVMContext Context;
+  std::unique_ptr<Module> M = parseAndVerify(Data, Size, Context);
+  if (!M)
+    // Not produced by the mutator; not interesting.
+    return 0;
+
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB;
+  llvmGetPassPluginInfo().RegisterPassBuilderCallbacks(PB);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM;
+  if (auto Err = PB.parsePassPipeline(
+          MPM, "function(hoist-anticipated-expressions)"))
+    report_fatal_error(std::move(Err));
+
+  auto Start = std::chrono::steady_clock::now();
+  MPM.run(*M, MAM);
+  auto Elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - Start);
+
+  if (unsigned(Elapsed.count()) > BudgetMs) {
+    errs() << "hoist-anticipated-expressions fuzz: compile-time budget "
+              "exceeded ("
+           << Elapsed.count() << " ms > " << BudgetMs << " ms)\n";
+    abort();
+  }
+  if (verifyModule(*M, &errs())) {
+    errs() << "hoist-anticipated-expressions fuzz: invalid IR after the "
+              "pass\n";
+    abort();
+  }
+  return 0;
+}
+
+extern "C" LLVM_ATTRIBUTE_USED int LLVMFuzzerInitialize(int *argc,
+                                                        char ***argv) {
+  parseFuzzerCLOpts(*argc, *argv);
+  Mutator = createMutator();
+  return 0;
+}
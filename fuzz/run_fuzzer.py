@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""Runs the hoist-anticipated-expressions libFuzzer target and keeps what it
+finds.
+
+  fuzz/run_fuzzer.py [--fuzzer build/fuzz/hoist-anticipated-expressions-fuzzer]
+      [--budget-ms 1000] [--max-total-time 600] [--jobs 1]
+  fuzz/run_fuzzer.py --replay
+
+A run:
+  1. seeds the working corpus (fuzz/corpus) with bench/corpus and
+     `llvm-stress` modules when it is empty,
+  2. fuzzes with a per-input budget for the pass (-hoist-fuzz-budget-ms) and a
+     libFuzzer -timeout for inputs on which the pass does not terminate,
+  3. minimizes every crash, budget overrun and timeout, and saves it as
+     fuzz/regressions/<kind>-<hash>.ll.
+
+--replay runs the fuzz target over fuzz/regressions instead and fails if any
+of them still crashes or exceeds the budget. The saved files are ordinary
+.ll modules, so bench/compile_time.py can time them as well.
+
+The exit status is non-zero when something new was found.
+"""
+
+import argparse
+import glob
+import hashlib
+import os
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.dirname(
+    os.path.abspath(__file__))), "bench"))
+import common  # noqa: E402
+
+FUZZ_DIR = os.path.dirname(os.path.abspath(__file__))
+FUZZER_NAME = "hoist-anticipated-expressions-fuzzer"
+ARTIFACT_KINDS = ("crash", "timeout", "oom", "slow-unit", "leak")
+
+
+def fuzzer_path(args):
+    if args.fuzzer:
+        return args.fuzzer
+    path = os.path.join(common.REPO_ROOT, "build", "fuzz", FUZZER_NAME)
+    if not os.path.exists(path):
+        sys.exit("error: fuzz target not found; configure with "
+                 "-DHOIST_ANTICIPATED_BUILD_FUZZER=ON or use --fuzzer")
+    return path
+
+
+def llvm_options(args):
+    """LLVM options for the fuzz target; libFuzzer ignores everything after
+    -ignore_remaining_args=1."""
+    return ["-ignore_remaining_args=1",
+            f"-hoist-fuzz-budget-ms={args.budget_ms}"]
+
+
+def timeout_seconds(args):
+    """libFuzzer's -timeout, well above the budget so that budget overruns
+    are reported as such and only non-terminating inputs time out."""
+    return max(1, 5 * args.budget_ms // 1000)
+
+
+def seed_corpus(args, corpus):
+    """Fills an empty corpus with bitcode of bench/corpus and of llvm-stress
+    modules of varying size."""
+    if os.listdir(corpus):
+        return
+    for path in common.corpus_files([]):
+        out = os.path.join(corpus, os.path.basename(path)[:-3] + ".bc")
+        common.run([common.tool(args, "llvm-as"), path, "-o", out])
+    for seed in range(args.stress_seeds):
+        ll = os.path.join(corpus, f"stress-{seed}.ll")
+        common.run([common.tool(args, "llvm-stress"), f"-seed={seed}",
+                    f"-size={50 + 25 * (seed % 8)}", "-o", ll])
+        common.run([common.tool(args, "llvm-as"), ll, "-o", ll[:-3] + ".bc"])
+        os.remove(ll)
+
+
+def minimize(args, fuzzer, artifact, out):
+    """Shrinks `artifact` to the smallest input that still fails; falls back
+    to the artifact itself if minimization does not get anywhere."""
+    common.run([fuzzer, "-minimize_crash=1", f"-runs={args.minimize_runs}",
+                f"-timeout={timeout_seconds(args)}",
+                f"-exact_artifact_path={out}", artifact] + llvm_options(args),
+               check=False)
+    if not os.path.exists(out):
+        with open(artifact, "rb") as src, open(out, "wb") as dst:
+            dst.write(src.read())
+
+
+def save_regression(args, kind, bitcode, reason):
+    """Disassembles `bitcode` into the regression corpus; returns the new
+    path, or None if the same input was saved before."""
+    with open(bitcode, "rb") as f:
+        digest = hashlib.sha1(f.read()).hexdigest()[:12]
+    os.makedirs(args.regressions, exist_ok=True)
+    path = os.path.join(args.regressions, f"{kind}-{digest}.ll")
+    if os.path.exists(path):
+        return None
+    ir = common.run([common.tool(args, "llvm-dis"), bitcode, "-o", "-"]).stdout
+    with open(path, "w") as f:
+        f.write(f"; Found by fuzz/run_fuzzer.py: {reason}\n")
+        f.write(ir)
+    return path
+
+
+def failure_reason(stderr):
+    """The first line explaining why the fuzz target failed."""
+    for line in stderr.splitlines():
+        if "hoist-anticipated-expressions fuzz:" in line:
+            return line.split("fuzz:", 1)[1].strip()
+        if "ERROR: libFuzzer:" in line or "LLVM ERROR:" in line:
+            return line.split("ERROR:", 1)[1].strip()
+    return "fuzz target failed"
+
+
+def fuzz(args, fuzzer):
+    os.makedirs(args.corpus, exist_ok=True)
+    seed_corpus(args, args.corpus)
+    found = []
+    with tempfile.TemporaryDirectory() as workdir:
+        artifacts = os.path.join(workdir, "artifacts") + os.sep
+        os.makedirs(artifacts)
+        cmd = [fuzzer, args.corpus, f"-artifact_prefix={artifacts}",
+               f"-timeout={timeout_seconds(args)}",
+               f"-max_total_time={args.max_total_time}",
+               # Fork mode keeps going after a finding, so one run can
+               # collect several.
+               f"-fork={args.jobs}", "-ignore_crashes=1",
+               "-ignore_timeouts=1", "-ignore_ooms=1"]
+        common.run(cmd + llvm_options(args), check=False)
+
+        for artifact in sorted(glob.glob(artifacts + "*")):
+            name = os.path.basename(artifact)
+            kind = next((k for k in ARTIFACT_KINDS if name.startswith(k)),
+                        None)
+            if not kind:
+                continue
+            minimized = artifact + ".min"
+            minimize(args, fuzzer, artifact, minimized)
+            # Re-run the minimized input to record why it fails.
+            proc = common.run([fuzzer, minimized] + llvm_options(args),
+                              check=False)
+            reason = failure_reason(proc.stderr)
+            if "budget exceeded" in reason:
+                kind = "slow"
+            path = save_regression(args, kind, minimized, reason)
+            if path:
+                found.append(path)
+                print(f"new {kind}: {path} ({reason})")
+    print(f"{len(found)} new input(s) saved to {args.regressions}")
+    return 1 if found else 0
+
+
+def replay(args, fuzzer):
+    if not os.path.isdir(args.regressions):
+        print(f"no regressions in {args.regressions}")
+        return 0
+    failed = 0
+    with tempfile.TemporaryDirectory() as workdir:
+        for path in common.corpus_files([args.regressions]):
+            bitcode = os.path.join(workdir, "input.bc")
+            common.run([common.tool(args, "llvm-as"), path, "-o", bitcode])
+            proc = common.run([fuzzer, f"-timeout={timeout_seconds(args)}",
+                               bitcode] + llvm_options(args), check=False)
+            status = "ok" if proc.returncode == 0 else "FAIL"
+            failed += status == "FAIL"
+            print(f"{os.path.basename(path):40} {status}"
+                  + ("" if status == "ok" else
+                     f"  {failure_reason(proc.stderr)}"))
+    return 1 if failed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--llvm-bin", default=os.environ.get("LLVM_BIN"),
+                        help="directory containing llvm-as/llvm-dis/"
+                             "llvm-stress (default: PATH)")
+    parser.add_argument("--fuzzer", help="path to the fuzz target "
+                        f"(default: build/fuzz/{FUZZER_NAME})")
+    parser.add_argument("--budget-ms", type=int, default=1000,
+                        help="time the pass may spend on one input")
+    parser.add_argument("--max-total-time", type=int, default=600,
+                        help="seconds to fuzz for")
+    parser.add_argument("--jobs", type=int, default=1,
+                        help="parallel fuzzing processes")
+    parser.add_argument("--minimize-runs", type=int, default=10000,
+                        help="attempts spent minimizing each finding")
+    parser.add_argument("--stress-seeds", type=int, default=64,
+                        help="llvm-stress modules used to seed the corpus")
+    parser.add_argument("--corpus", default=os.path.join(FUZZ_DIR, "corpus"),
+                        help="working corpus (default: fuzz/corpus)")
+    parser.add_argument("--regressions",
+                        default=os.path.join(FUZZ_DIR, "regressions"),
+                        help="where findings are saved "
+                             "(default: fuzz/regressions)")
+    parser.add_argument("--replay", action="store_true",
+                        help="check the saved regressions instead of fuzzing")
+    args = parser.parse_args()
+
+    fuzzer = fuzzer_path(args)
+    if args.replay:
+        return replay(args, fuzzer)
+    return fuzz(args, fuzzer)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
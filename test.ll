@@ -150,11 +150,15 @@ define dso_local i32 @for_loop_invariant_expr(i32 noundef %0, ptr noundef %1) #0
   %11 = srem i32 %10, %0
   %12 = add i32 %4, 1
   br label %3
+  ; The mul leaves the loop; the srem may trap (nothing says %0 is not
+  ; zero), so it stays below the loop condition in both arms.
   ; CHECK: %[[M:.*]] = mul
-  ; CHECK: srem i32 %[[M]], %{{.*}}
+  ; CHECK-NEXT: br label
   ; CHECK-NOT: mul
-  ; CHECK-NOT: srem
-  ; CHECK: ret
+  ; CHECK: srem i32 %[[M]], %0
+  ; CHECK-NEXT: ret
+  ; CHECK: srem i32 %[[M]], %0
+  ; CHECK-NEXT: add
 }
 
 ; Generated from a switch statement.
@@ -348,3 +352,49 @@ define dso_local i32 @not_anticipated_switch(i32 noundef %0, ptr noundef %1) {
   %13 = phi i32 [ %11, %8 ], [ %7, %3 ]
   ret i32 %13
 }
+
+; The decode arithmetic shared by every case of an interpreter's dispatch
+; switch is hoisted into the dispatch block, but no further: the loop header
+; defines the instruction word it depends on.
+; CHECK-LABEL: @dispatch_loop
+define i32 @dispatch_loop(ptr %code) {
+entry:
+  ; CHECK:      entry:
+  ; CHECK-NEXT:   br label %loop
+  br label %loop
+
+  ; CHECK:      loop:
+  ; CHECK:        %insn = load i32, ptr %pc
+  ; CHECK-NEXT:   %op = and i32 %insn, 3
+  ; CHECK-NEXT:   %a{{[0-9]}} = lshr i32 %insn, 8
+  ; CHECK-NEXT:   switch i32 %op
+loop:
+  %pc = phi ptr [ %code, %entry ], [ %next, %latch ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %latch ]
+  %insn = load i32, ptr %pc
+  %op = and i32 %insn, 3
+  switch i32 %op, label %halt [
+    i32 0, label %add
+    i32 1, label %xor
+  ]
+
+add:
+  %a1 = lshr i32 %insn, 8
+  %s1 = add i32 %acc, %a1
+  br label %latch
+
+xor:
+  %a2 = lshr i32 %insn, 8
+  %s2 = xor i32 %acc, %a2
+  br label %latch
+
+halt:
+  %a3 = lshr i32 %insn, 8
+  %r = add i32 %acc, %a3
+  ret i32 %r
+
+latch:
+  %acc.next = phi i32 [ %s1, %add ], [ %s2, %xor ]
+  %next = getelementptr i32, ptr %pc, i64 1
+  br label %loop
+}
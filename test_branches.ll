@@ -0,0 +1,101 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-verify-touched -S | FileCheck %s
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-fold-branches=false -S | FileCheck %s --check-prefix=OFF
+; RUN: opt < %s -passes=hoist-anticipated-expressions -opt-bisect-limit=2 -S 2>/dev/null | FileCheck %s --check-prefix=BISECT
+
+; Sibling blocks recompute the comparison they branch on. Once it is hoisted
+; and merged, the branch below another branch on it is decided by the edge
+; it is reached through.
+
+; The comparison is hoisted into %entry out of %left and %right, and the one
+; in %inner is merged into it. %inner is only reached when it is true.
+; CHECK-LABEL: @nested_check
+; CHECK:       entry:
+; CHECK-NEXT:    %c1 = icmp eq i32 %x, 0
+; CHECK-NEXT:    br i1 %p
+; CHECK:       left:
+; CHECK-NEXT:    br i1 %c1, label %inner, label %out
+; CHECK:       inner:
+; CHECK-NEXT:    call void @f(i32 1)
+; CHECK-NEXT:    br label %out
+; CHECK-NOT:   never:
+; CHECK:       out:
+; OFF-LABEL:   @nested_check
+; OFF:         inner:
+; OFF-NEXT:      call void @f(i32 1)
+; OFF-NEXT:      br i1 %c1, label %out, label %never
+; Every folded branch is a bisect point of its own: with the pass and the
+; hoist allowed, the branches stay.
+; BISECT-LABEL: @nested_check
+; BISECT:       inner:
+; BISECT-NEXT:    call void @f(i32 1)
+; BISECT-NEXT:    br i1 %c1, label %out, label %never
+define void @nested_check(i1 %p, i32 %x) {
+entry:
+  br i1 %p, label %left, label %right
+
+left:
+  %c1 = icmp eq i32 %x, 0
+  br i1 %c1, label %inner, label %out
+
+inner:
+  call void @f(i32 1)
+  %c3 = icmp eq i32 %x, 0
+  br i1 %c3, label %out, label %never
+
+never:
+  call void @f(i32 2)
+  br label %out
+
+right:
+  %c2 = icmp eq i32 %x, 0
+  br i1 %c2, label %out, label %other
+
+other:
+  call void @f(i32 3)
+  br label %out
+
+out:
+  ret void
+}
+
+; The comparison already decides the branch of %entry: the copies below
+; merge into it and both inner branches fold, on the true edge and on the
+; false edge.
+; CHECK-LABEL: @decided_by_entry
+; CHECK:       entry:
+; CHECK-NEXT:    %c = icmp slt i32 %x, %n
+; CHECK-NEXT:    br i1 %c, label %then, label %else
+; CHECK:       then:
+; CHECK-NEXT:    br label %ra
+; CHECK:       else:
+; CHECK-NEXT:    br label %rd
+; CHECK-NOT:   rb:
+; CHECK-NOT:   rc:
+; CHECK:         ret i32 4
+define i32 @decided_by_entry(i32 %x, i32 %n) {
+entry:
+  %c = icmp slt i32 %x, %n
+  br i1 %c, label %then, label %else
+
+then:
+  %c1 = icmp slt i32 %x, %n
+  br i1 %c1, label %ra, label %rb
+
+else:
+  %c2 = icmp slt i32 %x, %n
+  br i1 %c2, label %rc, label %rd
+
+ra:
+  ret i32 1
+
+rb:
+  ret i32 2
+
+rc:
+  ret i32 3
+
+rd:
+  ret i32 4
+}
+
+declare void @f(i32)
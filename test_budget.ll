@@ -0,0 +1,77 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-max-hoists=1 -S | FileCheck %s
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-max-hoists-per-block=1 -S | FileCheck %s --check-prefix=BLOCK
+; RUN: opt < %s -passes=hoist-anticipated-expressions -S | FileCheck %s --check-prefix=ALL
+
+; Hoists are ranked by the weighted cycles they save: with room for one, the
+; mul moved out of the loop wins over the add above it, which replaces two
+; copies but only trades the arms for the entry block and so saves nothing.
+; CHECK-LABEL: @most_saved
+; CHECK:       entry:
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    %a1 = add i32 %a, 1
+; CHECK:       pre:
+; CHECK:         %m0 = mul i32 %b, %b
+; CHECK-NEXT:    br label %loop
+; ALL-LABEL:   @most_saved
+; ALL:         entry:
+; ALL-NEXT:      %a1 = add i32 %a, 1
+; ALL-NEXT:      br i1 %c
+; ALL:         pre:
+; ALL:           %m0 = mul i32 %b, %b
+; ALL-NEXT:      br label %loop
+define i32 @most_saved(i32 %a, i32 %b, i32 %n, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %a1 = add i32 %a, 1
+  br label %pre
+
+else:
+  %a2 = add i32 %a, 1
+  br label %pre
+
+pre:
+  %q = phi i32 [ %a1, %then ], [ %a2, %else ]
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %pre ], [ %i.next, %loop ]
+  %p = phi i32 [ %q, %pre ], [ %s, %loop ]
+  %m0 = mul i32 %b, %b
+  %s = add i32 %p, %m0
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %s
+}
+
+; Every value moved into a block stays live across its branch. With room for
+; one, the division is moved out of the loop and the cheaper add stays.
+; BLOCK-LABEL: @pressure
+; BLOCK:       entry:
+; BLOCK-NEXT:    %d = udiv i32 %a, 7
+; BLOCK-NEXT:    br label %loop
+; BLOCK:       loop:
+; BLOCK:         %s = add i32 %b, 1
+define i32 @pressure(i32 %a, i32 %b, i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %r, %loop ]
+  %s = add i32 %b, 1
+  %d = udiv i32 %a, 7
+  %t = sub i32 %d, %s
+  %r = add i32 %acc, %t
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %r
+}
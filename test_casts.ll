@@ -0,0 +1,219 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-verify-dataflow -hoist-anticipated-verify-touched -S | FileCheck %s
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-widen-casts=false -S | FileCheck %s --check-prefix=OFF
+; RUN: opt < %s -passes=hoist-anticipated-expressions -opt-bisect-limit=1 -S 2>/dev/null | FileCheck %s --check-prefix=OFF
+
+; zext(a + b) with nuw is zext(a) + zext(b): the narrow form is rewritten
+; into the wide one, whose pieces are then hoisted one by one. The merged
+; add keeps only the flags both copies have.
+; CHECK-LABEL: @widen_add
+; CHECK:       entry:
+; CHECK-NEXT:    %a.wide = zext i8 %a to i32
+; CHECK-NEXT:    %b.wide = zext i8 %b to i32
+; CHECK-NEXT:    %s.wide = add i32 %a.wide, %b.wide
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    call void @use(i32 %s.wide)
+; CHECK:       else:
+; CHECK-NEXT:    call void @use(i32 %s.wide)
+; OFF-LABEL:   @widen_add
+; OFF:         entry:
+; OFF-NEXT:      br i1 %c
+define void @widen_add(i8 %a, i8 %b, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %s = add nuw i8 %a, %b
+  %z = zext i8 %s to i32
+  call void @use(i32 %z)
+  ret void
+
+else:
+  %za = zext i8 %a to i32
+  %zb = zext i8 %b to i32
+  %w = add i32 %za, %zb
+  call void @use(i32 %w)
+  ret void
+}
+
+; The wide add sits in a sibling of an outer arm: no hoist can merge the two,
+; so the zext stays as it is rather than being rewritten for nothing.
+; CHECK-LABEL: @widen_unrelated
+; CHECK:       inner:
+; CHECK-NEXT:    %s = add nuw i8 %a, %b
+; CHECK-NEXT:    %z = zext i8 %s to i32
+; CHECK-NEXT:    call void @use(i32 %z)
+define void @widen_unrelated(i8 %a, i8 %b, i1 %c, i1 %d) {
+entry:
+  br i1 %c, label %outer, label %sibling
+
+outer:
+  br i1 %d, label %inner, label %skip
+
+inner:
+  %s = add nuw i8 %a, %b
+  %z = zext i8 %s to i32
+  call void @use(i32 %z)
+  ret void
+
+skip:
+  ret void
+
+sibling:
+  %za = zext i8 %a to i32
+  %zb = zext i8 %b to i32
+  %w = add i32 %za, %zb
+  call void @use(i32 %w)
+  ret void
+}
+
+; Without a flag, known bits show that two 7-bit values cannot wrap i8.
+; CHECK-LABEL: @known_bits
+; CHECK:       entry:
+; CHECK:         %za = zext i8 %a to i32
+; CHECK-NEXT:    %zb = zext i8 %b to i32
+; CHECK-NEXT:    %w = add i32 %za, %zb
+; CHECK-NEXT:    br i1 %c
+define void @known_bits(i8 %x, i8 %y, i1 %c) {
+entry:
+  %a = and i8 %x, 127
+  %b = and i8 %y, 127
+  br i1 %c, label %then, label %else
+
+then:
+  %za = zext i8 %a to i32
+  %zb = zext i8 %b to i32
+  %w = add i32 %za, %zb
+  call void @use(i32 %w)
+  ret void
+
+else:
+  %s = add i8 %a, %b
+  %z = zext i8 %s to i32
+  call void @use(i32 %z)
+  ret void
+}
+
+; sext goes through nsw operations, following the operand order of the wide
+; form for commutative ones.
+; CHECK-LABEL: @signed_nested
+; CHECK:       entry:
+; CHECK-NEXT:    %b.wide = sext i8 %b to i32
+; CHECK-NEXT:    %a.wide = sext i8 %a to i32
+; CHECK-NEXT:    %k.wide = sext i8 %k to i32
+; CHECK-NEXT:    %m.wide = mul i32 %b.wide, %a.wide
+; CHECK-NEXT:    %s.wide = sub i32 %m.wide, %k.wide
+; CHECK-NEXT:    br i1 %c
+define void @signed_nested(i8 %a, i8 %b, i8 %k, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %m = mul nsw i8 %a, %b
+  %s = sub nsw i8 %m, %k
+  %z = sext i8 %s to i32
+  call void @use(i32 %z)
+  ret void
+
+else:
+  %sa = sext i8 %a to i32
+  %sb = sext i8 %b to i32
+  %sk = sext i8 %k to i32
+  %wm = mul i32 %sb, %sa
+  %ws = sub i32 %wm, %sk
+  call void @use(i32 %ws)
+  ret void
+}
+
+; An add that may wrap i8 is not the wide add.
+; CHECK-LABEL: @may_wrap
+; CHECK:       entry:
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    %s = add i8 %a, %b
+; CHECK-NEXT:    %z = zext i8 %s to i32
+define void @may_wrap(i8 %a, i8 %b, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %s = add i8 %a, %b
+  %z = zext i8 %s to i32
+  call void @use(i32 %z)
+  ret void
+
+else:
+  %za = zext i8 %a to i32
+  %zb = zext i8 %b to i32
+  %w = add i32 %za, %zb
+  call void @use(i32 %w)
+  ret void
+}
+
+; sext of a zext is one zext.
+; CHECK-LABEL: @ext_chain
+; CHECK:       entry:
+; CHECK-NEXT:    %s = zext i8 %a to i32
+; CHECK-NEXT:    br i1 %c
+; OFF-LABEL:   @ext_chain
+; OFF:         entry:
+; OFF-NEXT:      br i1 %c
+define void @ext_chain(i8 %a, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %h = zext i8 %a to i16
+  %s = sext i16 %h to i32
+  call void @use(i32 %s)
+  ret void
+
+else:
+  %z = zext i8 %a to i32
+  call void @use(i32 %z)
+  ret void
+}
+
+; A chain whose single cast nothing else computes is left alone: folding it
+; would merge nothing.
+; CHECK-LABEL: @ext_chain_alone
+; CHECK:       then:
+; CHECK-NEXT:    %h = zext i8 %a to i16
+; CHECK-NEXT:    %s = sext i16 %h to i32
+define void @ext_chain_alone(i8 %a, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %h = zext i8 %a to i16
+  %s = sext i16 %h to i32
+  call void @use(i32 %s)
+  ret void
+
+else:
+  %z = sext i8 %a to i32
+  call void @use(i32 %z)
+  ret void
+}
+
+; Truncating an extension back to its source width is the source.
+; CHECK-LABEL: @trunc_chain
+; CHECK:       entry:
+; CHECK-NEXT:    %n = add i8 %a, 1
+; CHECK-NEXT:    br i1 %c
+define i8 @trunc_chain(i8 %a, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %w = sext i8 %a to i32
+  %t = trunc i32 %w to i8
+  %n = add i8 %t, 1
+  ret i8 %n
+
+else:
+  %m = add i8 %a, 1
+  ret i8 %m
+}
+
+declare void @use(i32)
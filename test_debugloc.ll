@@ -0,0 +1,67 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -S | FileCheck %s
+
+; The instruction that survives a hoist gets the merged location of all the
+; occurrences it replaces, so sample profiles do not attribute the work of
+; both arms to one of them.
+
+; Different lines: the merged location is line 0 in the common scope.
+; CHECK-LABEL: @different_lines
+; CHECK:       entry:
+; CHECK-NEXT:    %m1 = mul i32 %a, %a, !dbg [[MERGED:![0-9]+]]
+
+; Identical locations (e.g. from a macro) are kept.
+; CHECK-LABEL: @same_location
+; CHECK:       entry:
+; CHECK-NEXT:    %m1 = mul i32 %a, %a, !dbg [[SAME:![0-9]+]]
+
+; CHECK:       [[MERGED]] = !DILocation(line: 0, scope: [[SP1:![0-9]+]])
+; CHECK:       [[SAME]] = !DILocation(line: 12, column: 5, scope: [[SP2:![0-9]+]])
+
+define i32 @different_lines(i32 %a, i1 %c) !dbg !5 {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %m1 = mul i32 %a, %a, !dbg !8
+  br label %exit
+
+else:
+  %m2 = mul i32 %a, %a, !dbg !9
+  br label %exit
+
+exit:
+  %r = phi i32 [ %m1, %then ], [ %m2, %else ]
+  ret i32 %r
+}
+
+define i32 @same_location(i32 %a, i1 %c) !dbg !10 {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %m1 = mul i32 %a, %a, !dbg !11
+  br label %exit
+
+else:
+  %m2 = mul i32 %a, %a, !dbg !11
+  br label %exit
+
+exit:
+  %r = phi i32 [ %m1, %then ], [ %m2, %else ]
+  ret i32 %r
+}
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: true, runtimeVersion: 0, emissionKind: FullDebug)
+!1 = !DIFile(filename: "debugloc.c", directory: "/tmp")
+!3 = !{i32 2, !"Debug Info Version", i32 3}
+!4 = !{i32 7, !"Dwarf Version", i32 5}
+!5 = distinct !DISubprogram(name: "different_lines", scope: !1, file: !1, line: 1, type: !6, scopeLine: 1, spFlags: DISPFlagDefinition | DISPFlagOptimized, unit: !0)
+!6 = !DISubroutineType(types: !7)
+!7 = !{}
+!8 = !DILocation(line: 3, column: 9, scope: !5)
+!9 = !DILocation(line: 5, column: 9, scope: !5)
+!10 = distinct !DISubprogram(name: "same_location", scope: !1, file: !1, line: 10, type: !6, scopeLine: 10, spFlags: DISPFlagDefinition | DISPFlagOptimized, unit: !0)
+!11 = !DILocation(line: 12, column: 5, scope: !10)
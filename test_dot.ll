@@ -0,0 +1,42 @@
+; RUN: opt < %s -passes=dot-anticipated-expressions -hoist-anticipated-dot-filename-prefix=%t -disable-output 2>&1 | FileCheck %s --check-prefix=LOG
+; RUN: FileCheck %s < %t.diamond.dot
+; RUN: opt < %s -passes=dot-anticipated-expressions -hoist-anticipated-dot-filename-prefix=%t.sum -hoist-anticipated-dot-summary-blocks=0 -disable-output 2>&1 | FileCheck %s --check-prefix=SUMLOG
+; RUN: FileCheck %s --check-prefix=SUMMARY < %t.sum.diamond.dot
+
+; Every block is labeled with its frequency, the sizes of its In/Out sets and
+; the expressions hoisted into and out of it, and filled with a heat color.
+
+; LOG: Writing '{{.*}}.diamond.dot'...
+; SUMLOG: Writing '{{.*}}.sum.diamond.dot'...
+
+; CHECK:      digraph "Anticipated expressions for 'diamond' function" {
+; CHECK:        Node[[ENTRY:0x[0-9a-f]+]] [label="%entry (freq 1.00)\lin 2, out 2\lhoisted in: 2\l  %m1 = mul i32 %a, %a\l  %s1 = add i32 %m1, %a\l", fillcolor="#{{[0-9a-f]+}}"];
+; CHECK-NEXT:   Node[[ENTRY]] -> Node[[THEN:0x[0-9a-f]+]];
+; CHECK-NEXT:   Node[[ENTRY]] -> Node[[ELSE:0x[0-9a-f]+]];
+; CHECK-NEXT:   Node[[THEN]] [label="%then (freq 0.50)\lin 1, out 0\lhoisted out: 2\l  %m1 = mul i32 %a, %a\l  %s1 = add i32 %m1, %a\l", fillcolor="#{{[0-9a-f]+}}"];
+; CHECK:        Node[[ELSE]] [label="%else (freq 0.50)\lin 1, out 0\lhoisted out: 2\l
+; CHECK:        [label="%exit (freq 1.00)\lin 0, out 0\l", fillcolor=
+; CHECK:      }
+
+; SUMMARY:      label="Anticipated expressions for 'diamond' function (summarized)";
+; SUMMARY:      [label="%entry (freq 1.00)\lin 2, out 2\lhoisted in: 2\l", fillcolor=
+; SUMMARY:      [label="%then (freq 0.50)\lin 1, out 0\lhoisted out: 2\l", fillcolor=
+
+define i32 @diamond(i32 %a, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %m1 = mul i32 %a, %a
+  %s1 = add i32 %m1, %a
+  br label %exit
+
+else:
+  %m2 = mul i32 %a, %a
+  %s2 = add i32 %m2, %a
+  br label %exit
+
+exit:
+  %r = phi i32 [ %s1, %then ], [ %s2, %else ]
+  ret i32 %r
+}
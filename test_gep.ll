@@ -0,0 +1,94 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-verify-dataflow -S | FileCheck %s
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-scev-equivalence=false -S | FileCheck %s
+
+%struct.S = type { i32, i32, i32 }
+
+; A field address and the same byte offset through i8 are one expression,
+; with or without ScalarEvolution. The survivor keeps only the flags both
+; GEPs have.
+; CHECK-LABEL: @field_offset
+; CHECK:       entry:
+; CHECK-NEXT:    %f1 = getelementptr %struct.S, ptr %p, i64 0, i32 2
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    store i32 0, ptr %f1
+; CHECK:       else:
+; CHECK-NEXT:    store i32 1, ptr %f1
+define void @field_offset(ptr %p, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %f1 = getelementptr inbounds %struct.S, ptr %p, i64 0, i32 2
+  store i32 0, ptr %f1
+  ret void
+
+else:
+  %f2 = getelementptr i8, ptr %p, i64 8
+  store i32 1, ptr %f2
+  ret void
+}
+
+; Flags both GEPs have are kept.
+; CHECK-LABEL: @common_flags
+; CHECK:       entry:
+; CHECK-NEXT:    %e1 = getelementptr inbounds i32, ptr %p, i64 4
+; CHECK-NEXT:    br i1 %c
+define i32 @common_flags(ptr %p, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %e1 = getelementptr inbounds i32, ptr %p, i64 4
+  %v1 = load i32, ptr %e1
+  ret i32 %v1
+
+else:
+  %e2 = getelementptr inbounds i8, ptr %p, i64 16
+  %v2 = load i32, ptr %e2
+  ret i32 %v2
+}
+
+; A variable index is not a constant offset, but GEPs that differ only in
+; their flags still compute the same address.
+; CHECK-LABEL: @variable_index
+; CHECK:       entry:
+; CHECK-NEXT:    %x1 = getelementptr i32, ptr %p, i64 %i
+; CHECK-NEXT:    br i1 %c
+define i32 @variable_index(ptr %p, i64 %i, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %x1 = getelementptr inbounds i32, ptr %p, i64 %i
+  %v1 = load i32, ptr %x1
+  ret i32 %v1
+
+else:
+  %x2 = getelementptr i32, ptr %p, i64 %i
+  %v2 = load i32, ptr %x2
+  ret i32 %v2
+}
+
+; Different offsets from the same pointer stay apart.
+; CHECK-LABEL: @different_offset
+; CHECK:       entry:
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    %d1 = getelementptr i8, ptr %p, i64 4
+; CHECK:       else:
+; CHECK-NEXT:    %d2 = getelementptr i8, ptr %p, i64 8
+define i32 @different_offset(ptr %p, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %d1 = getelementptr i8, ptr %p, i64 4
+  %v1 = load i32, ptr %d1
+  ret i32 %v1
+
+else:
+  %d2 = getelementptr i8, ptr %p, i64 8
+  %v2 = load i32, ptr %d2
+  ret i32 %v2
+}
@@ -0,0 +1,67 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-verify-dataflow -S | FileCheck %s
+
+; The In/Out sets of every iteration are checked against the reference
+; solver; shapes it once disagreed with the engine on are kept here.
+
+; Two identical instructions in one arm count once: %m is not anticipated
+; on the other arm and stays where it is.
+; CHECK-LABEL: @duplicates_in_one_arm
+; CHECK:       entry:
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    %m1 = mul i32 %a, %a
+define i32 @duplicates_in_one_arm(i32 %a, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %m1 = mul i32 %a, %a
+  %m2 = mul i32 %a, %a
+  %s = add i32 %m1, %m2
+  ret i32 %s
+
+else:
+  ret i32 %a
+}
+
+; A self-loop computes %x on every trip, and so does the exit: %x is
+; anticipated at the end of the loop, the copy in the exit is merged, and the
+; loop-invariant result then leaves the loop.
+; CHECK-LABEL: @self_loop
+; CHECK:       entry:
+; CHECK-NEXT:    %x1 = xor i32 %a, %b
+; CHECK-NEXT:    %cond = icmp ult i32 %x1, 5
+; CHECK-NEXT:    br label %loop
+; CHECK:       exit:
+; CHECK-NEXT:    %r = add i32 %x1, 1
+define i32 @self_loop(i32 %a, i32 %b) {
+entry:
+  br label %loop
+
+loop:
+  %x1 = xor i32 %a, %b
+  %cond = icmp ult i32 %x1, 5
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  %x2 = xor i32 %a, %b
+  %r = add i32 %x2, 1
+  ret i32 %r
+}
+
+; A block that only loops to itself anticipates its own expressions, which
+; must not be "hoisted" into it over and over.
+; CHECK-LABEL: @endless_loop
+; CHECK:       entry:
+; CHECK-NEXT:    %x = xor i32 %a, %b
+; CHECK:       loop:
+; CHECK-NEXT:    store i32 %x, ptr %p
+define void @endless_loop(i32 %a, i32 %b, ptr %p) {
+entry:
+  br label %loop
+
+loop:
+  %x = xor i32 %a, %b
+  store i32 %x, ptr %p
+  br label %loop
+}
@@ -0,0 +1,81 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-provenance -S | FileCheck %s
+; RUN: opt < %s -passes=hoist-anticipated-expressions -S | FileCheck %s --check-prefix=OFF
+
+; With -hoist-anticipated-provenance every hoisted instruction lists the block
+; and debug location of each occurrence it replaces.
+
+; CHECK-LABEL: @diamond
+; CHECK:       entry:
+; CHECK-NEXT:    %m1 = mul i32 %a, %a, !dbg !{{[0-9]+}}, !hoist.provenance [[MUL:![0-9]+]]
+; CHECK-NEXT:    br i1 %c
+
+; Occurrences are listed in the order they are found (the moved one first,
+; then its copies breadth-first); locations are left out without debug info.
+
+; CHECK-LABEL: @nested
+; CHECK:       entry:
+; CHECK-NEXT:    %m1 = mul i32 %a, %a, !hoist.provenance [[NESTED:![0-9]+]]
+
+; CHECK:       [[MUL]] = !{[[THEN:![0-9]+]], [[ELSE:![0-9]+]]}
+; CHECK-NEXT:  [[THEN]] = !{!"%then", !"diamond.c", i32 4, i32 9}
+; CHECK-NEXT:  [[ELSE]] = !{!"%else", !"diamond.c", i32 7, i32 11}
+; CHECK-NEXT:  [[NESTED]] = !{[[T1:![0-9]+]], [[E:![0-9]+]], [[T2:![0-9]+]]}
+; CHECK-NEXT:  [[T1]] = !{!"%t1"}
+; CHECK-NEXT:  [[E]] = !{!"%else"}
+; CHECK-NEXT:  [[T2]] = !{!"%t2"}
+
+; OFF-NOT: !hoist.provenance
+
+define i32 @diamond(i32 %a, i1 %c) !dbg !5 {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %m1 = mul i32 %a, %a, !dbg !8
+  br label %exit
+
+else:
+  %m2 = mul i32 %a, %a, !dbg !9
+  br label %exit
+
+exit:
+  %r = phi i32 [ %m1, %then ], [ %m2, %else ]
+  ret i32 %r
+}
+
+define i32 @nested(i32 %a, i1 %c, i1 %d) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  br i1 %d, label %t1, label %t2
+
+t1:
+  %m1 = mul i32 %a, %a
+  br label %exit
+
+t2:
+  %m2 = mul i32 %a, %a
+  br label %exit
+
+else:
+  %m3 = mul i32 %a, %a
+  br label %exit
+
+exit:
+  %r = phi i32 [ %m1, %t1 ], [ %m2, %t2 ], [ %m3, %else ]
+  ret i32 %r
+}
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: true, runtimeVersion: 0, emissionKind: FullDebug)
+!1 = !DIFile(filename: "diamond.c", directory: "/tmp")
+!3 = !{i32 2, !"Debug Info Version", i32 3}
+!4 = !{i32 7, !"Dwarf Version", i32 5}
+!5 = distinct !DISubprogram(name: "diamond", scope: !1, file: !1, line: 1, type: !6, scopeLine: 1, spFlags: DISPFlagDefinition | DISPFlagOptimized, unit: !0)
+!6 = !DISubroutineType(types: !7)
+!7 = !{}
+!8 = !DILocation(line: 4, column: 9, scope: !5)
+!9 = !DILocation(line: 7, column: 11, scope: !5)
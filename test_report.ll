@@ -0,0 +1,97 @@
+; RUN: opt < %s -passes='print<hoist-anticipated-expressions>' -disable-output 2>&1 | FileCheck %s --check-prefix=REPORT
+; RUN: opt < %s -passes='print<hoist-anticipated-expressions>' -S 2>/dev/null | FileCheck %s --check-prefix=IR
+
+; The report pass only simulates the hoists; the IR must be left untouched.
+
+; REPORT-LABEL: Hoist report for function 'diamond':
+; REPORT-NEXT:    %m1 = mul i32 %a, %a
+; REPORT-NEXT:      into %entry (freq 1.00) from %then (freq 0.50), %else (freq 0.50)
+; REPORT-NEXT:      cost {{[0-9]+}}, saved 0.00 weighted cycles
+; REPORT-NEXT:    %s1 = add i32 %m1, %a
+; REPORT-NEXT:      into %entry (freq 1.00) from %then (freq 0.50), %else (freq 0.50)
+; REPORT-NEXT:      cost {{[0-9]+}}, saved 0.00 weighted cycles
+; REPORT-NEXT:    function total: 2 hoists, 0.00 weighted cycles saved
+
+; IR-LABEL: @diamond
+; IR:       then:
+; IR-NEXT:    %m1 = mul i32 %a, %a
+; IR-NEXT:    %s1 = add i32 %m1, %a
+; IR:       else:
+; IR-NEXT:    %m2 = mul i32 %a, %a
+; IR-NEXT:    %s2 = add i32 %m2, %a
+define i32 @diamond(i32 %a, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %m1 = mul i32 %a, %a
+  %s1 = add i32 %m1, %a
+  br label %exit
+
+else:
+  %m2 = mul i32 %a, %a
+  %s2 = add i32 %m2, %a
+  br label %exit
+
+exit:
+  %r = phi i32 [ %s1, %then ], [ %s2, %else ]
+  ret i32 %r
+}
+
+; Hoisting out of the loop body saves one execution per iteration.
+
+; REPORT-LABEL: Hoist report for function 'loop':
+; REPORT-NEXT:    %m1 = mul i32 %a, %a
+; REPORT-NEXT:      into %entry (freq 1.00) from %body (freq {{[0-9.]+}}), %exit (freq 1.00)
+; REPORT-NEXT:      cost {{[0-9]+}}, saved {{[1-9][0-9.]*}} weighted cycles
+; REPORT-NEXT:    function total: 1 hoists, {{[1-9][0-9.]*}} weighted cycles saved
+
+; IR-LABEL: @loop
+; IR:       body:
+; IR-NEXT:    %m1 = mul i32 %a, %a
+define i32 @loop(i32 %a) {
+entry:
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  %cmp = icmp ult i32 %i, 10
+  br i1 %cmp, label %body, label %exit
+
+body:
+  %m1 = mul i32 %a, %a
+  %i.next = add i32 %i, 1
+  br label %header
+
+exit:
+  %m2 = mul i32 %a, %a
+  ret i32 %m2
+}
+
+; Copies merged into an instruction the target already computes save every
+; execution of theirs: nothing new executes in the target.
+
+; REPORT-LABEL: Hoist report for function 'merge':
+; REPORT-NEXT:    %x = mul i32 %a, %a
+; REPORT-NEXT:      into %entry (freq 1.00) from %then (freq 0.50), %else (freq 0.50)
+; REPORT-NEXT:      cost [[COST:[0-9]+]], saved [[COST]].00 weighted cycles
+; REPORT-NEXT:    function total: 1 hoists, [[COST]].00 weighted cycles saved
+; REPORT-NEXT:  Module total: 4 hoists, {{[1-9][0-9.]*}} weighted cycles saved
+define i32 @merge(i32 %a, i1 %c) {
+entry:
+  %x = mul i32 %a, %a
+  br i1 %c, label %then, label %else
+
+then:
+  %m1 = mul i32 %a, %a
+  br label %exit
+
+else:
+  %m2 = mul i32 %a, %a
+  br label %exit
+
+exit:
+  %r = phi i32 [ %m1, %then ], [ %m2, %else ]
+  %s = add i32 %r, %x
+  ret i32 %s
+}
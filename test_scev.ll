@@ -0,0 +1,107 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-verify-dataflow -S | FileCheck %s
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-scev-equivalence=false -S | FileCheck %s --check-prefix=OFF
+
+; Instructions with the same SCEV are one expression: i*4+base in one arm
+; and (i<<2)+base in the other both compute (4 * %i) and then base plus it.
+; The scaled index is hoisted first, which makes the adds identical.
+; CHECK-LABEL: @scaled_index
+; CHECK:       entry:
+; CHECK-NEXT:    %m = mul i64 %i, 4
+; CHECK-NEXT:    %a1 = add i64 %m, %base
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    call void @use(i64 %a1)
+; CHECK:       else:
+; CHECK-NEXT:    call void @use(i64 %a1)
+; OFF-LABEL:   @scaled_index
+; OFF:         then:
+; OFF-NEXT:      %m = mul i64 %i, 4
+; OFF:         else:
+; OFF-NEXT:      %s = shl i64 %i, 2
+define void @scaled_index(i64 %i, i64 %base, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %m = mul i64 %i, 4
+  %a1 = add i64 %m, %base
+  call void @use(i64 %a1)
+  ret void
+
+else:
+  %s = shl i64 %i, 2
+  %a2 = add i64 %s, %base
+  call void @use(i64 %a2)
+  ret void
+}
+
+; Addresses of the same element through differently typed GEPs. Each
+; instruction is killed by its own operands: the byte offset has to be
+; available above the branch for %g2 to count.
+; CHECK-LABEL: @gep_element
+; CHECK:       entry:
+; CHECK-NEXT:    %off = shl i64 %i, 2
+; CHECK-NEXT:    %g1 = getelementptr i32, ptr %p, i64 %i
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    store i32 0, ptr %g1
+; CHECK:       else:
+; CHECK-NEXT:    store i32 1, ptr %g1
+define void @gep_element(ptr %p, i64 %i, i1 %c) {
+entry:
+  %off = shl i64 %i, 2
+  br i1 %c, label %then, label %else
+
+then:
+  %g1 = getelementptr i32, ptr %p, i64 %i
+  store i32 0, ptr %g1
+  ret void
+
+else:
+  %g2 = getelementptr i8, ptr %p, i64 %off
+  store i32 1, ptr %g2
+  ret void
+}
+
+; The survivor must not be poison where the copy it replaces is not: the nuw
+; of the shl is dropped when it stands in for the plain mul.
+; CHECK-LABEL: @drop_flags
+; CHECK:       entry:
+; CHECK-NEXT:    %s = shl i32 %x, 1
+; CHECK-NEXT:    br i1 %c
+define i32 @drop_flags(i32 %x, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %s = shl nuw i32 %x, 1
+  ret i32 %s
+
+else:
+  %m = mul i32 %x, 2
+  ret i32 %m
+}
+
+; x - x and y & 0 are both the constant 0 to SCEV, but the sub is poison
+; when %x is and the and when %y is: they are not the same expression.
+; CHECK-LABEL: @poison_operands
+; CHECK:       entry:
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    %z1 = sub i32 %x, %x
+; CHECK:       else:
+; CHECK-NEXT:    %z2 = and i32 %y, 0
+define i32 @poison_operands(i32 %x, i32 %y, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %z1 = sub i32 %x, %x
+  ret i32 %z1
+
+else:
+  %z2 = and i32 %y, 0
+  ret i32 %z2
+}
+
+declare void @use(i64)
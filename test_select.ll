@@ -0,0 +1,90 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-verify-touched -S | FileCheck %s
+; RUN: opt < %s -passes=hoist-anticipated-expressions -hoist-anticipated-select-arms=false -S | FileCheck %s --check-prefix=OFF
+; RUN: opt < %s -passes=hoist-anticipated-expressions -opt-bisect-limit=1 -S 2>/dev/null | FileCheck %s --check-prefix=OFF
+
+; Selects are diamonds SimplifyCFG has flattened: their arms are merged
+; instead of hoisted.
+
+; The same expression in both arms: the select is either of them.
+; CHECK-LABEL: @equivalent_arms
+; CHECK-NEXT:    %m1 = mul i32 %a, %b
+; CHECK-NEXT:    ret i32 %m1
+; OFF-LABEL:   @equivalent_arms
+; OFF:           select
+define i32 @equivalent_arms(i1 %c, i32 %a, i32 %b) {
+  %m1 = mul i32 %a, %b
+  %m2 = mul i32 %a, %b
+  %s = select i1 %c, i32 %m1, i32 %m2
+  ret i32 %s
+}
+
+; select c, x + 7, y + 7 adds 7 to select c, x, y; the nsw both arms share
+; is kept.
+; CHECK-LABEL: @same_operation
+; CHECK-NEXT:    %s.arm = select i1 %c, i32 %x, i32 %y
+; CHECK-NEXT:    %s = add nsw i32 %s.arm, 7
+; CHECK-NEXT:    ret i32 %s
+define i32 @same_operation(i1 %c, i32 %x, i32 %y) {
+  %x1 = add nsw i32 %x, 7
+  %y1 = add nuw nsw i32 %y, 7
+  %s = select i1 %c, i32 %x1, i32 %y1
+  ret i32 %s
+}
+
+; The operand trees are merged from the select down: the shared scale is
+; computed once, and only the offsets are selected.
+; CHECK-LABEL: @operand_tree
+; CHECK-NEXT:    %m1 = mul i32 %a, %b
+; CHECK-NEXT:    %s.arm = select i1 %c, i32 %x, i32 %y
+; CHECK-NEXT:    %s = add i32 %m1, %s.arm
+; CHECK-NEXT:    ret i32 %s
+define i32 @operand_tree(i1 %c, i32 %a, i32 %b, i32 %x, i32 %y) {
+  %m1 = mul i32 %a, %b
+  %x1 = add i32 %m1, %x
+  %m2 = mul i32 %a, %b
+  %y1 = add i32 %m2, %y
+  %s = select i1 %c, i32 %x1, i32 %y1
+  ret i32 %s
+}
+
+; Comparisons with the same predicate.
+; CHECK-LABEL: @compare
+; CHECK-NEXT:    %s.arm = select i1 %c, i32 %x, i32 %y
+; CHECK-NEXT:    %s = icmp ult i32 %s.arm, %n
+define i1 @compare(i1 %c, i32 %x, i32 %y, i32 %n) {
+  %x1 = icmp ult i32 %x, %n
+  %y1 = icmp ult i32 %y, %n
+  %s = select i1 %c, i1 %x1, i1 %y1
+  ret i1 %s
+}
+
+; Not folded: both operands differ, so two selects would replace one mul;
+; an arm has another use; a select of divisors would trap on a poison
+; condition.
+; CHECK-LABEL: @not_profitable
+; CHECK:         select i1 %c, i32 %x1, i32 %y1
+; CHECK-LABEL: @multiple_uses
+; CHECK:         select i1 %c, i32 %x1, i32 %y1
+; CHECK-LABEL: @division
+; CHECK:         select i1 %c, i32 %x1, i32 %y1
+define i32 @not_profitable(i1 %c, i32 %a, i32 %b, i32 %x, i32 %y) {
+  %x1 = mul i32 %a, %x
+  %y1 = mul i32 %b, %y
+  %s = select i1 %c, i32 %x1, i32 %y1
+  ret i32 %s
+}
+
+define i32 @multiple_uses(i1 %c, i32 %x, i32 %y) {
+  %x1 = add i32 %x, 7
+  %y1 = add i32 %y, 7
+  %s = select i1 %c, i32 %x1, i32 %y1
+  %r = add i32 %s, %x1
+  ret i32 %r
+}
+
+define i32 @division(i1 %c, i32 %a, i32 %x, i32 %y) {
+  %x1 = udiv i32 %a, %x
+  %y1 = udiv i32 %a, %y
+  %s = select i1 %c, i32 %x1, i32 %y1
+  ret i32 %s
+}
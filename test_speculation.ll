@@ -0,0 +1,164 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -S | FileCheck %s
+
+; Division and remainder trap on a zero divisor (and sdiv/srem on INT_MIN / -1),
+; so they are hoisted only where the divisor is known to be safe.
+
+; Nothing is known about %d: the urem stays in both arms.
+; CHECK-LABEL: @unknown_divisor
+; CHECK:       entry:
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    %r1 = urem i32 %x, %d
+; CHECK:       else:
+; CHECK-NEXT:    %r2 = urem i32 %x, %d
+define i32 @unknown_divisor(i32 %x, i32 %d, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %r1 = urem i32 %x, %d
+  ret i32 %r1
+
+else:
+  %r2 = urem i32 %x, %d
+  ret i32 %r2
+}
+
+; A dominating branch on %d != 0 protects the udiv in %check, but not in
+; %entry, where it is not anticipated anyway.
+; CHECK-LABEL: @dominating_branch
+; CHECK:       check:
+; CHECK-NEXT:    %q1 = udiv i32 %x, %d
+; CHECK-NEXT:    br i1 %c
+define i32 @dominating_branch(i32 %x, i32 %d, i1 %c) {
+entry:
+  %nz = icmp ne i32 %d, 0
+  br i1 %nz, label %check, label %zero
+
+check:
+  br i1 %c, label %then, label %else
+
+then:
+  %q1 = udiv i32 %x, %d
+  ret i32 %q1
+
+else:
+  %q2 = udiv i32 %x, %d
+  ret i32 %q2
+
+zero:
+  ret i32 0
+}
+
+; An llvm.assume that %d is not zero. %d is noundef, so it is not poison
+; either.
+; CHECK-LABEL: @assumed_divisor
+; CHECK:       entry:
+; CHECK:         call void @llvm.assume
+; CHECK-NEXT:    %q1 = udiv i32 %x, %d
+; CHECK-NEXT:    br i1 %c
+define i32 @assumed_divisor(i32 %x, i32 noundef %d, i1 %c) {
+entry:
+  %nz = icmp ne i32 %d, 0
+  call void @llvm.assume(i1 %nz)
+  br i1 %c, label %then, label %else
+
+then:
+  %q1 = udiv i32 %x, %d
+  ret i32 %q1
+
+else:
+  %q2 = udiv i32 %x, %d
+  ret i32 %q2
+}
+
+; A guard that %d is not zero.
+; CHECK-LABEL: @guarded_divisor
+; CHECK:       entry:
+; CHECK:         call void (i1, ...) @llvm.experimental.guard
+; CHECK-NEXT:    %r1 = urem i32 %x, %d
+; CHECK-NEXT:    br i1 %c
+define i32 @guarded_divisor(i32 %x, i32 noundef %d, i1 %c) {
+entry:
+  %nz = icmp ne i32 %d, 0
+  call void (i1, ...) @llvm.experimental.guard(i1 %nz) [ "deopt"() ]
+  br i1 %c, label %then, label %else
+
+then:
+  %r1 = urem i32 %x, %d
+  ret i32 %r1
+
+else:
+  %r2 = urem i32 %x, %d
+  ret i32 %r2
+}
+
+; The known bits of %d1 say it is odd.
+; CHECK-LABEL: @odd_divisor
+; CHECK:       entry:
+; CHECK-NEXT:    %d1 = or i32 %d, 1
+; CHECK-NEXT:    %q1 = udiv i32 %x, %d1
+; CHECK-NEXT:    br i1 %c
+define i32 @odd_divisor(i32 %x, i32 noundef %d, i1 %c) {
+entry:
+  %d1 = or i32 %d, 1
+  br i1 %c, label %then, label %else
+
+then:
+  %q1 = udiv i32 %x, %d1
+  ret i32 %q1
+
+else:
+  %q2 = udiv i32 %x, %d1
+  ret i32 %q2
+}
+
+; %d > 0 rules out both zero and -1 for the sdiv; %d != 0 alone leaves
+; INT_MIN / -1 possible.
+; CHECK-LABEL: @signed_division
+; CHECK:       positive:
+; CHECK-NEXT:    %q1 = sdiv i32 %x, %d
+; CHECK-NEXT:    br i1 %c
+; CHECK:       nonzero:
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then2:
+; CHECK-NEXT:    %q3 = sdiv i32 %x, %d
+; CHECK:       else2:
+; CHECK-NEXT:    %q4 = sdiv i32 %x, %d
+define i32 @signed_division(i32 %x, i32 %d, i1 %c) {
+entry:
+  %pos = icmp sgt i32 %d, 0
+  br i1 %pos, label %positive, label %notpositive
+
+positive:
+  br i1 %c, label %then1, label %else1
+
+then1:
+  %q1 = sdiv i32 %x, %d
+  ret i32 %q1
+
+else1:
+  %q2 = sdiv i32 %x, %d
+  ret i32 %q2
+
+notpositive:
+  %nz = icmp ne i32 %d, 0
+  br i1 %nz, label %nonzero, label %zero
+
+nonzero:
+  br i1 %c, label %then2, label %else2
+
+then2:
+  %q3 = sdiv i32 %x, %d
+  ret i32 %q3
+
+else2:
+  %q4 = sdiv i32 %x, %d
+  ret i32 %q4
+
+zero:
+  ret i32 0
+}
+
+declare void @llvm.assume(i1)
+declare void @llvm.experimental.guard(i1, ...)
@@ -0,0 +1,24 @@
+; RUN: opt < %s -passes=hoist-anticipated-expressions -time-trace -time-trace-granularity=0 -time-trace-file=%t.json -disable-output
+; RUN: FileCheck %s < %t.json
+
+; Under -time-trace the pass records a scope per function, with one per phase
+; of every iteration nested in it.
+; CHECK-DAG: "name":"HoistAnticipatedExpressions","args":{"detail":"diamond"}
+; CHECK-DAG: "name":"HoistAnticipatedExpressions.Dataflow"
+; CHECK-DAG: "name":"HoistAnticipatedExpressions.Hoist"
+define i32 @diamond(i32 %a, i32 %b, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %x = add i32 %a, %b
+  br label %exit
+
+else:
+  %y = add i32 %a, %b
+  br label %exit
+
+exit:
+  %r = phi i32 [ %x, %then ], [ %y, %else ]
+  ret i32 %r
+}
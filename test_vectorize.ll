@@ -0,0 +1,112 @@
+; RUN: opt < %s -passes='hoist-anticipated-expressions<vectorize>' -S | FileCheck %s
+; RUN: opt < %s -passes=hoist-anticipated-expressions -S | FileCheck %s --check-prefix=PLAIN
+; RUN: opt < %s -passes='default<O2>' -hoist-anticipated-pipeline-position=vectorizer-start -debug-pass-manager -disable-output 2>&1 | FileCheck %s --check-prefix=EP
+
+; In vectorization-friendly mode a hoist into a loop must leave a predicated
+; block of the loop with nothing but its terminator. Here both arms keep their
+; call, so the vectorizer predicates them either way: the mul stays in the
+; arms. Outside the loop, the division is hoisted as usual.
+; CHECK-LABEL: @arms_stay
+; CHECK:       entry:
+; CHECK-NEXT:    %p1 = udiv i32 %x, 7
+; CHECK-NEXT:    br i1 %c
+; CHECK:       then:
+; CHECK-NEXT:    %m1 = mul i32 %i, %x
+; CHECK:       else:
+; CHECK-NEXT:    %m2 = mul i32 %i, %x
+; PLAIN-LABEL: @arms_stay
+; PLAIN:       entry:
+; PLAIN-NEXT:    %p1 = udiv i32 %x, 7
+; PLAIN-NEXT:    br i1 %c
+; PLAIN:       loop:
+; PLAIN:         %m1 = mul i32 %i, %x
+; PLAIN-NEXT:    br i1 %odd
+; PLAIN:       then:
+; PLAIN-NEXT:    call void @use(i32 %m1)
+define i32 @arms_stay(i32 %n, i32 %x, i1 %c) {
+entry:
+  br i1 %c, label %pre.t, label %pre.f
+
+pre.t:
+  %p1 = udiv i32 %x, 7
+  br label %loop
+
+pre.f:
+  %p2 = udiv i32 %x, 7
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %pre.t ], [ 0, %pre.f ], [ %i.next, %latch ]
+  %s = phi i32 [ %p1, %pre.t ], [ %p2, %pre.f ], [ %s.next, %latch ]
+  %odd = trunc i32 %i to i1
+  br i1 %odd, label %then, label %else
+
+then:
+  %m1 = mul i32 %i, %x
+  call void @use(i32 %m1)
+  br label %latch
+
+else:
+  %m2 = mul i32 %i, %x
+  call void @use(i32 %m2)
+  br label %latch
+
+latch:
+  %s.next = add i32 %s, %i
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %s.next
+}
+
+; Arms computing the same chain empty once the chain is hoisted link by link,
+; which leaves the loop body without predicated work.
+; CHECK-LABEL: @arms_empty
+; CHECK:       loop:
+; CHECK:         %d1 = add i32 %i, 3
+; CHECK-NEXT:    %r1 = mul i32 %d1, %x
+; CHECK-NEXT:    br i1 %odd
+; CHECK:       then:
+; CHECK-NEXT:    br label %latch
+; CHECK:       else:
+; CHECK-NEXT:    br label %latch
+define i32 @arms_empty(i32 %n, i32 %x) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %s = phi i32 [ 0, %entry ], [ %s.next, %latch ]
+  %odd = trunc i32 %i to i1
+  br i1 %odd, label %then, label %else
+
+then:
+  %d1 = add i32 %i, 3
+  %r1 = mul i32 %d1, %x
+  br label %latch
+
+else:
+  %d2 = add i32 %i, 3
+  %r2 = mul i32 %d2, %x
+  br label %latch
+
+latch:
+  %r = phi i32 [ %r1, %then ], [ %r2, %else ]
+  %s.next = add i32 %s, %r
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %s.next
+}
+
+; The vectorizer-start position puts the pass right in front of the loop
+; vectorizer in the default pipelines.
+; EP:          Running pass: {{.*}}HoistAnticipatedExpressionsPass on arms_stay
+; EP-NOT:      Running pass: {{.*}}HoistAnticipatedExpressionsPass on arms_stay
+; EP:          Running pass: LoopVectorizePass on arms_stay
+
+declare void @use(i32)